@@ -28,10 +28,14 @@ DISABLE_WARNING_SYMBOL_NOT_DEFINED
 DISABLE_WARNING_POP
 
 #include "esz.h"
+#include "esz_atlas.h"
+#include "esz_batch.h"
 #include "esz_compat.h"
 #include "esz_hash.h"
 #include "esz_init.h"
 #include "esz_render.h"
+#include "esz_simulation.h"
+#include "esz_texture.h"
 #include "esz_types.h"
 #include "esz_utils.h"
 
@@ -65,14 +69,27 @@ void esz_clear_player_state(esz_state state, esz_core_t* core)
         return;
     }
 
+    SDL_LockMutex(core->simulation.lock);
+
     if (core->map->entity)
     {
         if (core->map->entity[core->camera.target_actor_id].actor)
         {
-            esz_actor_t* actor = core->map->entity[core->map->active_player_actor_id].actor;
-            CLR_STATE(actor->state, state);
+            esz_entity_t* entity = &core->map->entity[core->map->active_player_actor_id];
+
+            set_actor_render_layers_dirty(entity, core);
+            CLR_STATE(entity->actor->state, state);
+
+            // The actor may move to another entry of the draw order.
+            if (is_actor_layer_state(state))
+            {
+                update_actor_draw_layers(core);
+                set_actor_render_layers_dirty(entity, core);
+            }
         }
     }
+
+    SDL_UnlockMutex(core->simulation.lock);
 }
 
 esz_status esz_create_window(const char* window_title, esz_window_config_t* config, esz_window_t** window)
@@ -128,11 +145,43 @@ esz_status esz_create_window(const char* window_title, esz_window_config_t* conf
     (*window)->logical_height = config->logical_height;
     (*window)->vsync_enabled  = config->enable_vsync;
 
+    (*window)->direct_composition_enabled = config->enable_direct_composition;
+    (*window)->has_focus                  = true;
+    (*window)->is_headless                = config->enable_headless_mode;
+    (*window)->is_redraw_required         = true;
+    (*window)->low_power_enabled          = config->enable_low_power_mode;
+    (*window)->render_scale               = 1.0;
+    (*window)->texture_memory_budget      = ESZ_TEXTURE_BUDGET;
+
+    // Without render targets, there is nothing to scale.
+    if (config->enable_dynamic_resolution && ! config->enable_direct_composition)
+    {
+        (*window)->dynamic_resolution_enabled = true;
+    }
+
+    if (config->enable_nearest_neighbour)
+    {
+        SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+    }
+
     if (config->enable_fullscreen)
     {
         (*window)->flags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
     }
 
+    /* Headless mode: the dummy video driver doesn't need a display
+     * and renders into an offscreen framebuffer.
+     */
+    if ((*window)->is_headless)
+    {
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+        SDL_SetHint(SDL_HINT_RENDER_DRIVER, "software");
+
+        (*window)->flags         = 0;
+        (*window)->vsync_enabled = false;
+        renderer_flags           = SDL_RENDERER_SOFTWARE | SDL_RENDERER_TARGETTEXTURE;
+    }
+
     if (0 > SDL_Init(SDL_INIT_VIDEO))
     {
         plog_error("%s: %s.", __func__, SDL_GetError());
@@ -193,7 +242,7 @@ esz_status esz_create_window(const char* window_title, esz_window_config_t* conf
     /* Get index of opengl rendering driver and create 2D rendering
      * context.
      */
-    for (int32_t index = 0; index < SDL_GetNumRenderDrivers(); index += 1)
+    for (int32_t index = 0; index < SDL_GetNumRenderDrivers() && ! (*window)->is_headless; index += 1)
     {
         SDL_RendererInfo renderer_info = { 0 };
         SDL_GetRenderDriverInfo(index, &renderer_info);
@@ -223,7 +272,10 @@ esz_status esz_create_window(const char* window_title, esz_window_config_t* conf
         SDL_RendererInfo renderer_info = { 0 };
         SDL_GetRenderDriverInfo(0, &renderer_info);
 
-        plog_warn("opengl not found: use default rendering driver: %s.", renderer_info.name);
+        if (! (*window)->is_headless)
+        {
+            plog_warn("opengl not found: use default rendering driver: %s.", renderer_info.name);
+        }
 
         (*window)->renderer = SDL_CreateRenderer((*window)->window, -1, renderer_flags);
 
@@ -235,6 +287,14 @@ esz_status esz_create_window(const char* window_title, esz_window_config_t* conf
         }
     }
 
+    if (config->enable_integer_scaling)
+    {
+        if (0 > SDL_RenderSetIntegerScale((*window)->renderer, SDL_TRUE))
+        {
+            plog_warn("%s: %s.", __func__, SDL_GetError());
+        }
+    }
+
     plog_info(
         "Setting up window at resolution %dx%d @ %d Hz.",
         (*window)->width,
@@ -262,6 +322,18 @@ void esz_destroy_core(esz_core_t* core)
 {
     if (core)
     {
+        esz_stop_simulation_thread(core);
+
+        if (core->simulation.snapshot_lock)
+        {
+            SDL_DestroyMutex(core->simulation.snapshot_lock);
+        }
+
+        if (core->simulation.lock)
+        {
+            SDL_DestroyMutex(core->simulation.lock);
+        }
+
         free(core);
         plog_info("Destroy engine core.");
     }
@@ -269,10 +341,10 @@ void esz_destroy_core(esz_core_t* core)
 
 void esz_destroy_window(esz_window_t* window)
 {
-    if (window->esz_logo)
-    {
-        SDL_DestroyTexture(window->esz_logo);
-    }
+    destroy_batch(window);
+
+    destroy_render_target_pool(window);
+    destroy_texture(&window->esz_logo, window);
 
     if (window->renderer)
     {
@@ -363,6 +435,21 @@ const char* esz_get_string_map_property(const uint64_t name_hash, esz_core_t* co
     return core->map->string_property;
 }
 
+double esz_get_render_scale(esz_window_t* window)
+{
+    return window->render_scale;
+}
+
+esz_render_stats_t esz_get_render_stats(esz_core_t* core)
+{
+    return core->render_stats;
+}
+
+size_t esz_get_texture_memory_usage(esz_window_t* window)
+{
+    return window->texture_memory_usage;
+}
+
 double esz_get_time_since_last_frame(esz_window_t* window)
 {
     return window->time_since_last_frame;
@@ -373,6 +460,11 @@ void esz_hide_render_layer(esz_render_layer layer, esz_core_t* core)
     if (ESZ_RENDER_LAYER_MAX != layer)
     {
         SET_STATE(core->debug, (uint32_t)layer);
+
+        if (core->is_map_loaded)
+        {
+            SET_STATE(core->map->render_layer_dirty, (uint32_t)layer);
+        }
     }
 }
 
@@ -385,7 +477,19 @@ esz_status esz_init_core(esz_core_t** core)
         return ESZ_ERROR_CRITICAL;
     }
 
-    (*core)->is_active = true;
+    (*core)->is_active           = true;
+    (*core)->chunk_memory_budget = ESZ_MAP_CHUNK_BUDGET;
+    (*core)->chunk_bake_time     = ESZ_MAP_CHUNK_BAKE_TIME;
+
+    (*core)->simulation.lock          = SDL_CreateMutex();
+    (*core)->simulation.snapshot_lock = SDL_CreateMutex();
+
+    if (! (*core)->simulation.lock || ! (*core)->simulation.snapshot_lock)
+    {
+        plog_error("%s: %s.", __func__, SDL_GetError());
+        esz_destroy_core(*core);
+        return ESZ_ERROR_CRITICAL;
+    }
 
     return ESZ_OK;
 }
@@ -443,6 +547,9 @@ esz_status esz_load_map(const char* map_file_name, esz_window_t* window, esz_cor
         return ESZ_WARNING;
     }
 
+    // The simulation thread must not see a partially loaded map.
+    SDL_LockMutex(core->simulation.lock);
+
     // Load map file and allocate required memory
     // ------------------------------------------------------------------------
 
@@ -453,6 +560,7 @@ esz_status esz_load_map(const char* map_file_name, esz_window_t* window, esz_cor
     if (! core->map)
     {
         plog_error("%s: error allocating memory.", __func__);
+        SDL_UnlockMutex(core->simulation.lock);
         return ESZ_WARNING;
     }
 
@@ -465,9 +573,14 @@ esz_status esz_load_map(const char* map_file_name, esz_window_t* window, esz_cor
     }
     core->is_map_loaded = true;
 
-    // 3. Tile properties
+    // 3. Tile layer index and tile properties
     // ------------------------------------------------------------------------
 
+    if (ESZ_OK != load_tile_layer_index(core))
+    {
+        goto warning;
+    }
+
     if (ESZ_OK != load_tile_properties(core))
     {
         goto warning;
@@ -489,23 +602,47 @@ esz_status esz_load_map(const char* map_file_name, esz_window_t* window, esz_cor
         goto warning;
     }
 
-    // 6. Tileset
+    // 6. Draw order
+    // ------------------------------------------------------------------------
+
+    if (ESZ_OK != load_draw_order(core))
+    {
+        goto warning;
+    }
+
+    // 7. Tileset
+    // ------------------------------------------------------------------------
+
+    if (ESZ_OK != load_tileset(core))
+    {
+        goto warning;
+    }
+
+    // 8. Sprites
     // ------------------------------------------------------------------------
 
-    if (ESZ_OK != load_tileset(window, core))
+    if (ESZ_OK != load_sprites(core))
     {
         goto warning;
     }
 
-    // 7. Sprites
+    // 9. Texture atlas
     // ------------------------------------------------------------------------
 
-    if (ESZ_OK != load_sprites(window, core))
+    if (ESZ_OK != load_texture_atlas(window, core))
     {
         goto warning;
     }
 
-    // 8. Animated tiles
+    // 10. Map chunks
+    // ------------------------------------------------------------------------
+
+    if (ESZ_OK != load_map_chunks(core))
+    {
+        goto warning;
+    }
+
+    // 11. Animated tiles
     // ------------------------------------------------------------------------
 
     if (ESZ_OK != load_animated_tiles(core))
@@ -513,7 +650,7 @@ esz_status esz_load_map(const char* map_file_name, esz_window_t* window, esz_cor
         goto warning;
     }
 
-    // 9. Background
+    // 12. Background
     // ------------------------------------------------------------------------
 
     if (ESZ_OK != load_background(window, core))
@@ -521,6 +658,14 @@ esz_status esz_load_map(const char* map_file_name, esz_window_t* window, esz_cor
         goto warning;
     }
 
+    // 13. Scene snapshots
+    // ------------------------------------------------------------------------
+
+    if (ESZ_OK != create_snapshots(core))
+    {
+        goto warning;
+    }
+
     plog_info(
         "Set gravitational constant to %f (g*%dpx/s^2).",
         core->map->gravitation, core->map->meter_in_pixel);
@@ -544,13 +689,30 @@ esz_status esz_load_map(const char* map_file_name, esz_window_t* window, esz_cor
     core->map->gravitation    = esz_get_decimal_map_property(H_gravitation, core);
     core->map->meter_in_pixel = esz_get_integer_map_property(H_meter_in_pixel, core);
 
+    // 14. Map chunks around the initial camera position
+    // ------------------------------------------------------------------------
+
+    // Move the camera to where it will be on the first frame.
+    core->camera.logical_width  = window->logical_width;
+    core->camera.logical_height = window->logical_height;
+    move_camera_to_target(core);
+    publish_snapshot(core);
+    acquire_snapshot(core);
+
+    if (ESZ_OK != bake_nearby_map_chunks(0.0, 0, window, core))
+    {
+        goto warning;
+    }
+
     plog_info(
         "Load map file: %s containing %d entities(s).",
         map_file_name, core->map->entity_count);
 
+    SDL_UnlockMutex(core->simulation.lock);
     return ESZ_OK;
 warning:
     esz_unload_map(window, core);
+    SDL_UnlockMutex(core->simulation.lock);
     return ESZ_WARNING;
 }
 
@@ -600,6 +762,16 @@ void esz_set_active_player_actor(int32_t id, esz_core_t* core)
     core->map->active_player_actor_id = id;
 }
 
+void esz_set_map_chunk_bake_time(const double bake_time, esz_core_t* core)
+{
+    core->chunk_bake_time = bake_time;
+}
+
+void esz_set_map_chunk_budget(const size_t budget, esz_core_t* core)
+{
+    core->chunk_memory_budget = budget;
+}
+
 void esz_set_next_player_animation(esz_core_t* core)
 {
     if (! esz_is_map_loaded(core))
@@ -646,6 +818,8 @@ void esz_set_player_animation(int32_t id, esz_core_t* core)
             {
                 actor->current_frame = 0;
                 actor->current_animation = id;
+
+                set_actor_render_layers_dirty(&core->map->entity[core->map->active_player_actor_id], core);
             }
         }
     }
@@ -658,20 +832,35 @@ void esz_set_player_state(esz_state state, esz_core_t* core)
         return;
     }
 
+    SDL_LockMutex(core->simulation.lock);
+
     if (core->map->entity)
     {
         if (core->map->entity[core->camera.target_actor_id].actor)
         {
-            esz_actor_t* actor = core->map->entity[core->map->active_player_actor_id].actor;
-            SET_STATE(actor->state, state);
+            esz_entity_t* entity = &core->map->entity[core->map->active_player_actor_id];
+
+            set_actor_render_layers_dirty(entity, core);
+            SET_STATE(entity->actor->state, state);
+
+            // The actor may move to another entry of the draw order.
+            if (is_actor_layer_state(state))
+            {
+                update_actor_draw_layers(core);
+                set_actor_render_layers_dirty(entity, core);
+            }
         }
     }
+
+    SDL_UnlockMutex(core->simulation.lock);
 }
 
 void esz_set_camera_position(const double pos_x, const double pos_y, bool pos_is_relative, esz_window_t* window, esz_core_t* core)
 {
     if (! esz_is_camera_locked(core))
     {
+        SDL_LockMutex(core->simulation.lock);
+
         if (pos_is_relative)
         {
             double time_factor = (window->time_since_last_frame * 1000.0);
@@ -685,7 +874,9 @@ void esz_set_camera_position(const double pos_x, const double pos_y, bool pos_is
             core->camera.pos_y = pos_y;
         }
 
-        set_camera_boundaries_to_map_size(window, core);
+        set_camera_boundaries_to_map_size(core);
+
+        SDL_UnlockMutex(core->simulation.lock);
     }
 }
 
@@ -694,6 +885,108 @@ void esz_set_camera_target(const int32_t id, esz_core_t* core)
     core->camera.target_actor_id = id;
 }
 
+void esz_set_texture_budget(const size_t budget, esz_window_t* window)
+{
+    window->texture_memory_budget = budget;
+}
+
+esz_status esz_set_tile(const uint64_t layer_name_hash, int32_t index_width, int32_t index_height, int32_t gid, esz_window_t* window, esz_core_t* core)
+{
+    esz_tiled_layer_t* layer;
+    int32_t*           layer_content;
+    int32_t            tile_index;
+    int32_t            previous_gid;
+    int32_t            animation_length = 0;
+    int32_t            layer_index      = 0;
+    esz_status         status           = ESZ_OK;
+
+    if (! esz_is_map_loaded(core))
+    {
+        plog_warn("No map has been loaded.");
+        return ESZ_WARNING;
+    }
+
+    if (0 > index_width  || index_width  >= (int32_t)core->map->handle->width ||
+        0 > index_height || index_height >= (int32_t)core->map->handle->height)
+    {
+        plog_warn("%s: tile %d,%d is out of bounds.", __func__, index_width, index_height);
+        return ESZ_WARNING;
+    }
+
+    if (0 != gid && ! is_gid_valid(remove_gid_flip_bits(gid), core->map->handle))
+    {
+        plog_warn("%s: invalid gid %d.", __func__, gid);
+        return ESZ_WARNING;
+    }
+
+    // The tile properties and chunks are shared with the simulation.
+    SDL_LockMutex(core->simulation.lock);
+
+    layer = get_head_layer(core->map->handle);
+    while (layer)
+    {
+        if (is_tiled_layer_of_type(ESZ_TILE_LAYER, layer, core) &&
+            layer_name_hash == generate_hash((const unsigned char*)get_layer_name(layer)))
+        {
+            break;
+        }
+        layer_index += 1;
+        layer        = layer->next;
+    }
+
+    if (! layer)
+    {
+        plog_warn("%s: tile layer not found.", __func__);
+        status = ESZ_WARNING;
+        goto exit;
+    }
+
+    layer_content = get_layer_content(layer);
+    tile_index    = (index_height * (int32_t)core->map->handle->width) + index_width;
+    previous_gid  = remove_gid_flip_bits((int32_t)layer_content[tile_index]);
+
+    // Animated tiles are laid out once when the map is loaded.
+    if (is_tile_layer_animated(layer_index, core))
+    {
+        if ((is_gid_valid(previous_gid, core->map->handle) && is_tile_animated(previous_gid, &animation_length, NULL, core->map->handle) && 0 < animation_length) ||
+            (0 != gid && is_tile_animated(remove_gid_flip_bits(gid), &animation_length, NULL, core->map->handle) && 0 < animation_length))
+        {
+            plog_warn("%s: animated tiles can't be changed at runtime.", __func__);
+            status = ESZ_WARNING;
+            goto exit;
+        }
+    }
+
+    layer_content[tile_index] = gid;
+
+    /* Cells that become empty are left in the layer index; they are
+     * skipped like any other empty cell.
+     */
+    if (0 != gid)
+    {
+        if (ESZ_OK != add_tile_to_layer_index(layer_index, index_width, index_height, core))
+        {
+            status = ESZ_ERROR_CRITICAL;
+            goto exit;
+        }
+    }
+
+    update_tile_properties(index_width, index_height, core);
+
+    if (0 <= core->map->tile_layer_level[layer_index])
+    {
+        if (ESZ_OK != patch_map_chunk(core->map->tile_layer_level[layer_index], index_width, index_height, window, core))
+        {
+            status = ESZ_ERROR_CRITICAL;
+            goto exit;
+        }
+    }
+
+exit:
+    SDL_UnlockMutex(core->simulation.lock);
+    return status;
+}
+
 esz_status esz_set_zoom_level(const double factor, esz_window_t* window)
 {
     window->zoom_level     = factor;
@@ -716,12 +1009,32 @@ void esz_show_render_layer(esz_render_layer layer, esz_core_t* core)
     if (ESZ_RENDER_LAYER_MAX != layer)
     {
         CLR_STATE(core->debug, (uint32_t)layer);
+
+        if (core->is_map_loaded)
+        {
+            SET_STATE(core->map->render_layer_dirty, (uint32_t)layer);
+        }
     }
 }
 
 esz_status esz_show_scene(esz_window_t* window, esz_core_t* core)
 {
     esz_status status;
+    double     frequency     = (double)SDL_GetPerformanceFrequency();
+    uint64_t   frame_counter = SDL_GetPerformanceCounter();
+    double     render_time;
+
+    // The last frame presented is still up to date.
+    if (window->low_power_enabled && is_scene_idle(window, core))
+    {
+        window->is_frame_skipped = true;
+
+        // Idle time isn't frame time.
+        window->last_frame_counter = 0;
+        return ESZ_OK;
+    }
+
+    window->is_frame_skipped = false;
 
     status = render_scene(window, core);
     if (ESZ_OK != status)
@@ -729,12 +1042,58 @@ esz_status esz_show_scene(esz_window_t* window, esz_core_t* core)
         goto exit;
     }
 
+    render_time = (double)(SDL_GetPerformanceCounter() - frame_counter) / frequency;
+
     status = draw_scene(window, core);
+    if (ESZ_OK == status)
+    {
+        window->is_redraw_required = false;
+    }
+
+    if (window->dynamic_resolution_enabled && 0 < window->last_frame_counter)
+    {
+        update_render_scale((double)(frame_counter - window->last_frame_counter) / frequency, render_time, window);
+    }
+    window->last_frame_counter = frame_counter;
 
 exit:
     return status;
 }
 
+esz_status esz_start_simulation_thread(esz_window_t* window, esz_core_t* core)
+{
+    if (core->simulation.thread)
+    {
+        return ESZ_OK;
+    }
+
+    core->simulation.window = window;
+    SDL_AtomicSet(&core->simulation.is_running, 1);
+
+    core->simulation.thread = SDL_CreateThread(run_simulation, "esz_simulation", (void*)core);
+    if (! core->simulation.thread)
+    {
+        plog_error("%s: %s.", __func__, SDL_GetError());
+        SDL_AtomicSet(&core->simulation.is_running, 0);
+        return ESZ_ERROR_CRITICAL;
+    }
+
+    return ESZ_OK;
+}
+
+void esz_stop_simulation_thread(esz_core_t* core)
+{
+    if (! core->simulation.thread)
+    {
+        return;
+    }
+
+    SDL_AtomicSet(&core->simulation.is_running, 0);
+    SDL_WaitThread(core->simulation.thread, NULL);
+
+    core->simulation.thread = NULL;
+}
+
 esz_status esz_toggle_fullscreen(esz_window_t* window)
 {
     esz_status status = ESZ_OK;
@@ -788,91 +1147,94 @@ void esz_unload_map(esz_window_t* window, esz_core_t* core)
 {
     esz_tiled_layer_t*  layer;
     esz_tiled_object_t* tiled_object = NULL;
+    int32_t             index        = 0;
 
     if (! esz_is_map_loaded(core))
     {
         plog_warn("No map has been loaded.");
         return;
     }
-    core->is_map_loaded           = false;
-    core->camera.target_actor_id = 0;
 
-    for (int32_t index = 0; index < ESZ_MAP_LAYER_LEVEL_MAX; index += 1)
-    {
-        if (core->map->layer_texture[index])
-        {
-            SDL_DestroyTexture(core->map->layer_texture[index]);
-            core->map->layer_texture[index] = NULL;
-        }
-    }
+    SDL_LockMutex(core->simulation.lock);
 
-    for (int32_t index = 0; index < ESZ_RENDER_LAYER_MAX; index += 1)
-    {
-        if (core->map->render_target[index])
-        {
-            SDL_DestroyTexture(core->map->render_target[index]);
-            core->map->render_target[index] = NULL;
-        }
-    }
+    core->is_map_loaded           = false;
+    core->camera.target_actor_id = 0;
+    window->is_redraw_required   = true;
 
-    if (core->map->animated_tile_texture)
-    {
-        SDL_DestroyTexture(core->map->animated_tile_texture);
-        core->map->animated_tile_texture = NULL;
-    }
+    release_render_targets(window, core);
 
     // Free up allocated memory in reverse order
     // ------------------------------------------------------------------------
 
-    // 9. Background
+    // 13. Scene snapshots
+    // ------------------------------------------------------------------------
+
+    destroy_snapshots(core);
+
+    // 12. Background
     // ------------------------------------------------------------------------
 
     if (0 < core->map->background.layer_count)
     {
         for (int32_t index = 0; index < core->map->background.layer_count; index += 1)
         {
-            if (core->map->background.layer[index].texture)
-            {
-                SDL_DestroyTexture(core->map->background.layer[index].texture);
-                core->map->background.layer[index].texture = NULL;
-            }
+            destroy_texture(&core->map->background.layer[index].texture, window);
         }
     }
 
     free(core->map->background.layer);
 
-    // 8. Animated tiles
+    // 11. Animated tiles
     // ------------------------------------------------------------------------
 
     free(core->map->animated_tile);
 
-    // 7. Sprites
+    for (int32_t index = 0; index < core->map->tile_animation_count; index += 1)
+    {
+        free(core->map->tile_animation[index].frame);
+    }
+
+    free(core->map->tile_animation);
+
+    // 10. Map chunks
     // ------------------------------------------------------------------------
 
-    if (0 < core->map->sprite_sheet_count)
+    if (core->map->chunk)
     {
-        for (int32_t index = 0; index < core->map->sprite_sheet_count; index += 1)
-        {
-            core->map->sprite[index].id = 0;
-
-            if (core->map->sprite[index].texture)
-            {
-                SDL_DestroyTexture(core->map->sprite[index].texture);
-                core->map->sprite[index].texture = NULL;
-            }
-        }
+        destroy_map_chunks(window, core);
     }
 
+    free(core->map->chunk);
+    free(core->map->chunk_layer_texture);
+    free(core->map->chunk_mip_texture);
+    free(core->map->chunk_animated_tile_overlay);
+
+    // 9. Texture atlas
+    // ------------------------------------------------------------------------
+
+    destroy_atlas(&core->map->atlas, window);
+
+    // 8. Sprites
+    // ------------------------------------------------------------------------
+
+    // The sprite textures are atlas pages and have already been
+    // destroyed along with the atlas.
     free(core->map->sprite);
 
-    // 6. Tileset
+    // 7. Tileset
     // ------------------------------------------------------------------------
 
-    if (core->map->tileset_texture)
-    {
-        SDL_DestroyTexture(core->map->tileset_texture);
-        core->map->tileset_texture = NULL;
-    }
+    // The tileset textures are atlas pages as well.
+    free(core->map->tileset);
+    free(core->map->tile_source);
+
+    // 6. Draw order
+    // ------------------------------------------------------------------------
+
+    free(core->map->draw_layer);
+    free(core->map->draw_entity);
+    free(core->map->level_render_layer);
+    free(core->map->tile_layer_level);
 
     // 5. Entities
     // ------------------------------------------------------------------------
@@ -882,8 +1244,7 @@ void esz_unload_map(esz_window_t* window, esz_core_t* core)
     {
         if (is_tiled_layer_of_type(ESZ_OBJECT_GROUP, layer, core))
         {
-            int32_t index = 0;
-            tiled_object  = get_head_object(layer, core);
+            tiled_object = get_head_object(layer, core);
 
             while (tiled_object)
             {
@@ -914,11 +1275,21 @@ void esz_unload_map(esz_window_t* window, esz_core_t* core)
 
     free(core->map->path);
 
-    // 3. Tile properties
+    // 3. Tile layer index and tile properties
     // ------------------------------------------------------------------------
 
     free(core->map->tile_properties);
 
+    if (core->map->tile_layer_index)
+    {
+        for (int32_t index = 0; index < core->map->layer_count; index += 1)
+        {
+            free(core->map->tile_layer_index[index].cell);
+            free(core->map->tile_layer_index[index].chunk_offset);
+        }
+        free(core->map->tile_layer_index);
+    }
+
     // 2. Tiled map
     // ------------------------------------------------------------------------
 
@@ -935,6 +1306,8 @@ void esz_unload_map(esz_window_t* window, esz_core_t* core)
     }
 
     plog_info("Unload map.");
+
+    SDL_UnlockMutex(core->simulation.lock);
 }
 
 void esz_unlock_camera(esz_core_t* core)
@@ -944,36 +1317,101 @@ void esz_unlock_camera(esz_core_t* core)
 
 void esz_update_core(esz_window_t* window, esz_core_t* core)
 {
-    double delta_time = 0.0;
-
+    double   frequency    = (double)SDL_GetPerformanceFrequency();
+    double   step_time    = 1.0 / (double)window->refresh_rate;
+    uint64_t counter;
+    int32_t  step_count   = 0;
+    bool     is_threaded  = SDL_AtomicGet(&core->simulation.is_running);
+    bool     is_throttled;
+
+    /* Event callbacks run in step with the simulation thread.  The
+     * logical size may change with the zoom level, so the camera gets
+     * its own copy instead of reading the window from the thread.
+     */
+    SDL_LockMutex(core->simulation.lock);
     poll_events(window, core);
+    core->camera.logical_width  = window->logical_width;
+    core->camera.logical_height = window->logical_height;
+    SDL_UnlockMutex(core->simulation.lock);
 
-    window->time_b = window->time_a;
-    window->time_a = SDL_GetTicks();
+    // Nobody is looking, so there is no point in updating at full rate.
+    is_throttled = window->low_power_enabled && (! window->has_focus || window->is_minimised);
 
-    if (window->time_a > window->time_b)
+    /* Without VSync, frames are paced to the refresh rate.  Skipped
+     * frames aren't presented, so VSync doesn't pace them either.
+     */
+    if (is_throttled || window->is_frame_skipped || (! window->vsync_enabled && ! window->is_headless))
     {
-        window->time_a = window->time_b;
+        uint64_t frame_period = (uint64_t)(frequency * step_time);
+
+        if (is_throttled)
+        {
+            frame_period = (uint64_t)(frequency / (double)ESZ_LOW_POWER_RATE);
+        }
+
+        wait_until(window->frame_deadline);
+
+        /* The deadline advances by whole periods so that it doesn't
+         * drift, unless a frame has been missed altogether.
+         */
+        counter                 = SDL_GetPerformanceCounter();
+        window->frame_deadline += frame_period;
+
+        if (window->frame_deadline < counter)
+        {
+            window->frame_deadline = counter + frame_period;
+        }
     }
 
-    delta_time                     = (double)(window->time_b - window->time_a) / 1000.0;
-    window->time_since_last_frame  = 1000.0 / (double)window->refresh_rate - delta_time;
+    counter = SDL_GetPerformanceCounter();
 
-    if (! window->vsync_enabled)
+    if (0 < window->last_update_counter)
     {
-        double delay = floor(window->time_since_last_frame);
-        SDL_Delay((uint32_t)delay);
+        window->time_since_last_frame = (double)(counter - window->last_update_counter) / frequency;
+        window->time_since_last_frame = SDL_min(window->time_since_last_frame, ESZ_FRAME_TIME_MAX);
+
+        // Scheduling jitter around the refresh period is not real frame cost.
+        if (fabs(window->time_since_last_frame - step_time) < ESZ_FRAME_TIME_SNAP)
+        {
+            window->time_since_last_frame = step_time;
+        }
+    }
+    else
+    {
+        window->time_since_last_frame = step_time;
     }
 
-    window->time_since_last_frame /= 1000.0;
+    window->last_update_counter = counter;
 
     if (! esz_is_map_loaded(core))
     {
+        window->time_accumulator = 0.0;
         return;
     }
 
-    move_camera_to_target(window, core);
-    update_entities(window, core);
+    if (! is_threaded)
+    {
+        /* The simulation advances in fixed steps; what is left of the
+         * frame time is carried over to the next frame.
+         */
+        window->time_accumulator += window->time_since_last_frame;
+
+        while (window->time_accumulator >= step_time && step_count < ESZ_SIMULATION_STEP_MAX)
+        {
+            update_simulation(step_time, window, core);
+
+            window->time_accumulator -= step_time;
+            step_count               += 1;
+        }
+
+        // Drop the backlog rather than falling further behind.
+        if (window->time_accumulator >= step_time)
+        {
+            window->time_accumulator = 0.0;
+        }
+    }
+
+    update_tile_animations(window, core);
 }
 
 DISABLE_WARNING_POP
@@ -22,9 +22,12 @@
 bool esz_bounding_boxes_do_intersect(const esz_aabb_t bb_a, const esz_aabb_t bb_b);
 
 /**
- * @brief Clears state of player actor
- * @param state Actor state ID
- * @param core Engine core
+ * @brief   Clears state of player actor
+ * @details Clearing STATE_IN_BACKGROUND, STATE_IN_MIDGROUND or
+ *          STATE_IN_FOREGROUND changes where in the draw order the
+ *          actor is drawn; see esz_load_map().
+ * @param   state Actor state ID
+ * @param   core Engine core
  */
 void esz_clear_player_state(esz_state state, esz_core_t* core);
 
@@ -114,10 +117,45 @@ const uint8_t* esz_get_keyboard_state(void);
  */
 int32_t esz_get_keycode(esz_core_t* core);
 
+/**
+ * @brief   Get the current render scale
+ * @details The scene is rendered at the logical size multiplied by this
+ *          factor.  The render targets are rounded up from that size
+ *          with some headroom and only reallocated once the scene no
+ *          longer fits or uses less than half of them.  It is always 1
+ *          unless dynamic resolution has been enabled in the window
+ *          configuration.
+ * @param   window Window handle
+ * @return  Render scale between ESZ_RENDER_SCALE_MIN and 1
+ */
+double esz_get_render_scale(esz_window_t* window);
+
+/**
+ * @brief   Get the render statistics of the last frame
+ * @details Contains the number of actors that have been drawn and the
+ *          number of actors that have been culled because they were
+ *          outside of the viewport, as well as the number of draw
+ *          commands and texture switches.
+ * @param   core Engine core
+ * @return  Render statistics
+ */
+esz_render_stats_t esz_get_render_stats(esz_core_t* core);
+
+/**
+ * @brief   Get the estimated video memory used by textures in bytes
+ * @details Covers every texture created by the engine: texture atlas
+ *          pages, background layers, render targets and baked map
+ *          chunks.
+ * @param   window Window handle
+ * @return  Estimated video memory usage in bytes
+ */
+size_t esz_get_texture_memory_usage(esz_window_t* window);
+
 /**
  * @brief  Get the time since the last frame in seconds
  * @param  window Window handle
- * @return Time since last frame in seconds
+ * @return Measured time since the last call of esz_update_core() in
+ *         seconds, clamped to ESZ_FRAME_TIME_MAX
  */
 double esz_get_time_since_last_frame(esz_window_t* window);
 
@@ -172,6 +210,14 @@ bool esz_is_player_moving(esz_core_t* core);
 
 /**
  * @brief     Load map file
+ * @details   Tile layers and the actors of each object group are drawn
+ *            in Tiled layer order, except for actors in the background
+ *            which are drawn behind all of them.  Maps that set the
+ *            is_in_foreground property on a tile layer are composed
+ *            the old way instead: such tile layers are drawn to
+ *            ESZ_MAP_FG and all others to ESZ_MAP_BG, while actors are
+ *            drawn to ESZ_ACTOR_BG, ESZ_ACTOR_MG or ESZ_ACTOR_FG
+ *            depending on their state.
  * @attention Before calling this function, make sure that the engine
  *            core has been initialised!
  * @param     map_file_name Path and file name to the map file
@@ -226,6 +272,27 @@ void esz_set_camera_position(const double pos_x, const double pos_y, bool pos_is
  */
 void esz_set_camera_target(const int32_t id, esz_core_t* core);
 
+/**
+ * @brief   Set the time per frame for baking map chunks ahead of time
+ * @details Chunks around the viewport are baked in order of their
+ *          distance to the camera, so that scrolling doesn't have to
+ *          bake them all at once.  The visible chunks are always baked
+ *          regardless of this limit.
+ * @param   bake_time Time in seconds; 0 disables baking ahead of time
+ * @param   core Engine core
+ */
+void esz_set_map_chunk_bake_time(const double bake_time, esz_core_t* core);
+
+/**
+ * @brief   Set the video memory budget for baked map chunks
+ * @details If the budget is exceeded, the least recently used chunks
+ *          that are outside of the viewport are evicted and baked
+ *          again once they become visible.
+ * @param   budget Budget in bytes
+ * @param   core Engine core
+ */
+void esz_set_map_chunk_budget(const size_t budget, esz_core_t* core);
+
 /**
  * @brief   Select and set the next animation of active player actor
  * @details If the last animation is skipped, it selects the first one
@@ -243,20 +310,62 @@ void esz_set_next_player_animation(esz_core_t* core);
 void esz_set_player_animation(int32_t id, esz_core_t* core);
 
 /**
- * @brief Set state of player actor
- * @param state Actor state ID
- * @param core Engine core
+ * @brief   Set state of player actor
+ * @details Setting STATE_IN_BACKGROUND, STATE_IN_MIDGROUND or
+ *          STATE_IN_FOREGROUND changes where in the draw order the
+ *          actor is drawn; see esz_load_map().
+ * @param   state Actor state ID
+ * @param   core Engine core
  */
 void esz_set_player_state(esz_state state, esz_core_t* core);
 
 /**
- * @brief  Set the window's zoom level
- * @param  factor Zoom factor
- * @param  window Window handle
- * @return Status code
- * @retval ESZ_OK OK
- * @retval ESZ_WARNING
- *         The zoom-level could not be set
+ * @brief   Set the video memory budget for all textures
+ * @details If the budget is exceeded, baked map chunks that are outside
+ *          of the viewport are evicted in least recently used order,
+ *          the same way as for the map chunk budget.  Textures that
+ *          can't be re-created, e.g. the texture atlas, are never
+ *          evicted and still count towards the budget.
+ * @param   budget Budget in bytes
+ * @param   window Window handle
+ */
+void esz_set_texture_budget(const size_t budget, esz_window_t* window);
+
+/**
+ * @brief     Change a single tile of a tile layer
+ * @details   The tile properties of the cell are updated and only the
+ *            cell itself is redrawn in the cached map chunk, so this is
+ *            cheap enough for destructible terrain or doors.
+ * @attention Animated tiles can neither be placed nor replaced on a
+ *            visible tile layer.
+ * @param     layer_name_hash Hash of the tile layer name
+ * @param     index_width Column of the tile
+ * @param     index_height Row of the tile
+ * @param     gid Global tile ID; 0 removes the tile
+ * @param     window Window handle
+ * @param     core Engine core
+ * @return    Status code
+ * @retval    ESZ_OK OK
+ * @retval    ESZ_WARNING
+ *            The tile could not be changed
+ * @retval    ESZ_ERROR_CRITICAL
+ *            Critical error; the application should be terminated
+ */
+esz_status esz_set_tile(const uint64_t layer_name_hash, int32_t index_width, int32_t index_height, int32_t gid, esz_window_t* window, esz_core_t* core);
+
+/**
+ * @brief   Set the window's zoom level
+ * @details The logical size is the window size divided by the factor,
+ *          and the render targets follow it as described for
+ *          esz_get_render_scale().  If the factor is below 1, the map is
+ *          drawn from downsampled copies of its baked chunks that match
+ *          the zoom level.
+ * @param   factor Zoom factor
+ * @param   window Window handle
+ * @return  Status code
+ * @retval  ESZ_OK OK
+ * @retval  ESZ_WARNING
+ *          The zoom-level could not be set
  */
 esz_status esz_set_zoom_level(const double factor, esz_window_t* window);
 
@@ -268,16 +377,47 @@ esz_status esz_set_zoom_level(const double factor, esz_window_t* window);
 void esz_show_render_layer(esz_render_layer layer, esz_core_t* core);
 
 /**
- * @brief  Render and draw the current scene
- * @param  window Window handle
- * @param  core Engine core
- * @return Status code
- * @retval ESZ_OK OK
- * @retval ESZ_ERROR_CRITICAL
- *         Critical error; the application should be terminated
+ * @brief   Render and draw the current scene
+ * @details If the low-power mode is enabled, nothing is rendered or
+ *          presented while the window is minimised or while nothing
+ *          visible has changed since the last frame.
+ * @param   window Window handle
+ * @param   core Engine core
+ * @return  Status code
+ * @retval  ESZ_OK OK
+ * @retval  ESZ_ERROR_CRITICAL
+ *          Critical error; the application should be terminated
  */
 esz_status esz_show_scene(esz_window_t* window, esz_core_t* core);
 
+/**
+ * @brief     Run the simulation on a separate thread
+ * @details   Camera, entities and background are then updated at the
+ *            display refresh rate independently of rendering.  Each
+ *            update publishes a scene snapshot which is picked up by
+ *            the next call of esz_show_scene().  Event callbacks are
+ *            executed in step with the simulation, so input reaches
+ *            it with the next simulation step.
+ * @attention esz_set_player_state(), esz_clear_player_state(),
+ *            esz_set_camera_position() and esz_set_tile() wait for the
+ *            current simulation step to finish.  Other functions that
+ *            modify the map or its actors must only be called from
+ *            event callbacks while the thread is running.
+ * @param     window Window handle
+ * @param     core Engine core
+ * @return    Status code
+ * @retval    ESZ_OK OK
+ * @retval    ESZ_ERROR_CRITICAL
+ *            Critical error; the thread could not be created
+ */
+esz_status esz_start_simulation_thread(esz_window_t* window, esz_core_t* core);
+
+/**
+ * @brief Stop the simulation thread and wait for it to finish
+ * @param core Engine core
+ */
+void esz_stop_simulation_thread(esz_core_t* core);
+
 /**
  * @brief  Toggle between fullscreen and windowed mode
  * @param  window Window handle
@@ -314,7 +454,13 @@ void esz_unlock_camera(esz_core_t* core);
 /**
  * @brief   Update engine core
  * @details This function should be called cyclically in the main loop
- *          of the application.
+ *          of the application.  Unless VSync is enabled, it also paces
+ *          the main loop to the display refresh rate.  The simulation
+ *          is advanced in fixed steps of one refresh period; the time
+ *          that is left over is carried over to the next frame.  If the
+ *          low-power mode is enabled, the main loop is slowed down to
+ *          ESZ_LOW_POWER_RATE while the window is unfocused or
+ *          minimised.
  * @param   window Window handle
  * @param   core Engine core
  */
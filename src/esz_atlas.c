@@ -0,0 +1,389 @@
+// SPDX-License-Identifier: MIT
+/**
+ * @file    esz_atlas.c
+ * @brief   eszFW texture atlas packer
+ * @details Decoded images are queued at map load and packed into as
+ *          few atlas pages as possible using a skyline bottom-left
+ *          heuristic.  The owners of the queued images receive the
+ *          page texture and the position of their image on it.
+ */
+
+#include <picolog.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL.h>
+
+#include "esz_atlas.h"
+#include "esz_texture.h"
+#include "esz_types.h"
+
+static int        compare_atlas_images(const void* image_a, const void* image_b);
+static esz_status create_atlas_page(int32_t page, int32_t width, int32_t height, esz_atlas_t* atlas, esz_window_t* window);
+static bool       fit_skyline(int32_t index, int32_t width, int32_t height, int32_t* pos_y, esz_atlas_node_t* node, int32_t page_width, int32_t page_height);
+static void       insert_skyline(int32_t index, int32_t width, int32_t height, int32_t pos_y, esz_atlas_node_t* node, int32_t* node_count);
+
+esz_status add_atlas_image(SDL_Surface* surface, SDL_Texture** texture, int32_t* offset_x, int32_t* offset_y, esz_atlas_t* atlas)
+{
+    esz_atlas_image_t* image;
+
+    image = (esz_atlas_image_t*)realloc(atlas->image, (size_t)(atlas->image_count + 1) * sizeof(struct esz_atlas_image));
+    if (! image)
+    {
+        plog_error("%s: error allocating memory.", __func__);
+        SDL_FreeSurface(surface);
+        return ESZ_ERROR_CRITICAL;
+    }
+
+    atlas->image = image;
+    image        = &atlas->image[atlas->image_count];
+
+    memset(image, 0, sizeof(struct esz_atlas_image));
+
+    image->surface  = surface;
+    image->texture  = texture;
+    image->offset_x = offset_x;
+    image->offset_y = offset_y;
+
+    atlas->image_count += 1;
+
+    return ESZ_OK;
+}
+
+esz_status build_atlas(esz_atlas_t* atlas, esz_window_t* window)
+{
+    esz_status        status      = ESZ_OK;
+    esz_atlas_node_t* node        = NULL;
+    int32_t*          page_width  = NULL;
+    int32_t*          page_height = NULL;
+    int32_t           node_count  = 0;
+    int32_t           max_width   = ESZ_ATLAS_PAGE_SIZE;
+    int32_t           max_height  = ESZ_ATLAS_PAGE_SIZE;
+    SDL_RendererInfo  renderer_info;
+
+    if (0 == atlas->image_count)
+    {
+        return ESZ_OK;
+    }
+
+    // Grow the page if a single image doesn't fit, but never beyond
+    // what the renderer is able to handle.
+    for (int32_t index = 0; index < atlas->image_count; index += 1)
+    {
+        int32_t width  = atlas->image[index].surface->w + ESZ_ATLAS_PADDING;
+        int32_t height = atlas->image[index].surface->h + ESZ_ATLAS_PADDING;
+
+        if (width > max_width)
+        {
+            max_width = width;
+        }
+
+        if (height > max_height)
+        {
+            max_height = height;
+        }
+    }
+
+    if (0 == SDL_GetRendererInfo(window->renderer, &renderer_info))
+    {
+        if (0 < renderer_info.max_texture_width && max_width > renderer_info.max_texture_width)
+        {
+            max_width = renderer_info.max_texture_width;
+        }
+
+        if (0 < renderer_info.max_texture_height && max_height > renderer_info.max_texture_height)
+        {
+            max_height = renderer_info.max_texture_height;
+        }
+    }
+
+    qsort(atlas->image, (size_t)atlas->image_count, sizeof(struct esz_atlas_image), compare_atlas_images);
+
+    node = (esz_atlas_node_t*)calloc((size_t)max_width + 1, sizeof(struct esz_atlas_node));
+    if (! node)
+    {
+        plog_error("%s: error allocating memory.", __func__);
+        status = ESZ_ERROR_CRITICAL;
+        goto exit;
+    }
+
+    // Each image may open a new page at worst.
+    page_width  = (int32_t*)calloc((size_t)atlas->image_count, sizeof(int32_t));
+    page_height = (int32_t*)calloc((size_t)atlas->image_count, sizeof(int32_t));
+    if (! page_width || ! page_height)
+    {
+        plog_error("%s: error allocating memory.", __func__);
+        status = ESZ_ERROR_CRITICAL;
+        goto exit;
+    }
+
+    for (int32_t index = 0; index < atlas->image_count; index += 1)
+    {
+        esz_atlas_image_t* image      = &atlas->image[index];
+        int32_t            width      = image->surface->w + ESZ_ATLAS_PADDING;
+        int32_t            height     = image->surface->h + ESZ_ATLAS_PADDING;
+        int32_t            best_index = -1;
+        int32_t            best_y     = max_height;
+
+        if (0 == node_count)
+        {
+            node[0].pos_x = 0;
+            node[0].pos_y = 0;
+            node[0].width = max_width;
+            node_count    = 1;
+        }
+
+        for (int32_t node_index = 0; node_index < node_count; node_index += 1)
+        {
+            int32_t pos_y;
+
+            if (fit_skyline(node_index, width, height, &pos_y, node, max_width, max_height) && pos_y < best_y)
+            {
+                best_index = node_index;
+                best_y     = pos_y;
+            }
+        }
+
+        if (-1 == best_index)
+        {
+            if (1 == node_count && 0 == node[0].pos_y)
+            {
+                plog_error("%s: image of %dx%d exceeds the maximum texture size.", __func__, image->surface->w, image->surface->h);
+                status = ESZ_ERROR_CRITICAL;
+                goto exit;
+            }
+
+            // Open a new page and try again.
+            atlas->page_count += 1;
+            node_count         = 0;
+            index             -= 1;
+            continue;
+        }
+
+        image->page  = atlas->page_count;
+        image->pos_x = node[best_index].pos_x;
+        image->pos_y = best_y;
+
+        insert_skyline(best_index, width, height, best_y, node, &node_count);
+
+        if (image->pos_x + image->surface->w > page_width[image->page])
+        {
+            page_width[image->page] = image->pos_x + image->surface->w;
+        }
+
+        if (image->pos_y + image->surface->h > page_height[image->page])
+        {
+            page_height[image->page] = image->pos_y + image->surface->h;
+        }
+    }
+
+    atlas->page_count += 1;
+
+    atlas->page = (SDL_Texture**)calloc((size_t)atlas->page_count, sizeof(SDL_Texture*));
+    if (! atlas->page)
+    {
+        plog_error("%s: error allocating memory.", __func__);
+        status = ESZ_ERROR_CRITICAL;
+        goto exit;
+    }
+
+    for (int32_t page = 0; page < atlas->page_count; page += 1)
+    {
+        if (ESZ_OK != create_atlas_page(page, page_width[page], page_height[page], atlas, window))
+        {
+            status = ESZ_ERROR_CRITICAL;
+            goto exit;
+        }
+
+        plog_info("Create texture atlas page %d (%dx%d).", page, page_width[page], page_height[page]);
+    }
+
+    for (int32_t index = 0; index < atlas->image_count; index += 1)
+    {
+        esz_atlas_image_t* image = &atlas->image[index];
+
+        *image->texture  = atlas->page[image->page];
+        *image->offset_x = image->pos_x;
+        *image->offset_y = image->pos_y;
+    }
+
+exit:
+    for (int32_t index = 0; index < atlas->image_count; index += 1)
+    {
+        SDL_FreeSurface(atlas->image[index].surface);
+    }
+
+    free(atlas->image);
+    atlas->image       = NULL;
+    atlas->image_count = 0;
+
+    free(page_height);
+    free(page_width);
+    free(node);
+
+    return status;
+}
+
+void destroy_atlas(esz_atlas_t* atlas, esz_window_t* window)
+{
+    for (int32_t index = 0; index < atlas->image_count; index += 1)
+    {
+        SDL_FreeSurface(atlas->image[index].surface);
+    }
+
+    free(atlas->image);
+    atlas->image       = NULL;
+    atlas->image_count = 0;
+
+    if (atlas->page)
+    {
+        for (int32_t page = 0; page < atlas->page_count; page += 1)
+        {
+            destroy_texture(&atlas->page[page], window);
+        }
+    }
+
+    free(atlas->page);
+    atlas->page       = NULL;
+    atlas->page_count = 0;
+}
+
+static int compare_atlas_images(const void* image_a, const void* image_b)
+{
+    const SDL_Surface* surface_a = ((const esz_atlas_image_t*)image_a)->surface;
+    const SDL_Surface* surface_b = ((const esz_atlas_image_t*)image_b)->surface;
+
+    // Tallest first, then widest first.
+    if (surface_a->h != surface_b->h)
+    {
+        return surface_b->h - surface_a->h;
+    }
+
+    return surface_b->w - surface_a->w;
+}
+
+static esz_status create_atlas_page(int32_t page, int32_t width, int32_t height, esz_atlas_t* atlas, esz_window_t* window)
+{
+    esz_status   status;
+    SDL_Surface* surface;
+
+    surface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_RGBA32);
+    if (! surface)
+    {
+        plog_error("%s: %s.", __func__, SDL_GetError());
+        return ESZ_ERROR_CRITICAL;
+    }
+
+    for (int32_t index = 0; index < atlas->image_count; index += 1)
+    {
+        esz_atlas_image_t* image = &atlas->image[index];
+        SDL_Rect           dst;
+
+        if (page != image->page)
+        {
+            continue;
+        }
+
+        dst.x = image->pos_x;
+        dst.y = image->pos_y;
+        dst.w = image->surface->w;
+        dst.h = image->surface->h;
+
+        // Copy the pixels as they are, including the alpha channel.
+        SDL_SetSurfaceBlendMode(image->surface, SDL_BLENDMODE_NONE);
+
+        if (0 > SDL_BlitSurface(image->surface, NULL, surface, &dst))
+        {
+            plog_error("%s: %s.", __func__, SDL_GetError());
+            SDL_FreeSurface(surface);
+            return ESZ_ERROR_CRITICAL;
+        }
+    }
+
+    status = create_texture_from_surface(&atlas->page[page], surface, window);
+    SDL_FreeSurface(surface);
+
+    return status;
+}
+
+static bool fit_skyline(int32_t index, int32_t width, int32_t height, int32_t* pos_y, esz_atlas_node_t* node, int32_t page_width, int32_t page_height)
+{
+    int32_t remaining_width = width;
+
+    if (node[index].pos_x + width > page_width)
+    {
+        return false;
+    }
+
+    *pos_y = node[index].pos_y;
+
+    while (remaining_width > 0)
+    {
+        if (node[index].pos_y > *pos_y)
+        {
+            *pos_y = node[index].pos_y;
+        }
+
+        if (*pos_y + height > page_height)
+        {
+            return false;
+        }
+
+        remaining_width -= node[index].width;
+        index           += 1;
+    }
+
+    return true;
+}
+
+static void insert_skyline(int32_t index, int32_t width, int32_t height, int32_t pos_y, esz_atlas_node_t* node, int32_t* node_count)
+{
+    int32_t pos_x = node[index].pos_x;
+
+    memmove(&node[index + 1], &node[index], (size_t)(*node_count - index) * sizeof(struct esz_atlas_node));
+
+    node[index].pos_x = pos_x;
+    node[index].pos_y = pos_y + height;
+    node[index].width = width;
+    *node_count      += 1;
+
+    // Trim or remove the segments covered by the new one.
+    while (index + 1 < *node_count)
+    {
+        int32_t right   = node[index].pos_x + node[index].width;
+        int32_t overlap = right - node[index + 1].pos_x;
+
+        if (0 >= overlap)
+        {
+            break;
+        }
+
+        node[index + 1].pos_x += overlap;
+        node[index + 1].width -= overlap;
+
+        if (0 < node[index + 1].width)
+        {
+            break;
+        }
+
+        memmove(&node[index + 1], &node[index + 2], (size_t)(*node_count - index - 2) * sizeof(struct esz_atlas_node));
+        *node_count -= 1;
+    }
+
+    // Merge neighbouring segments of the same height.
+    for (int32_t node_index = 0; node_index + 1 < *node_count;)
+    {
+        if (node[node_index].pos_y == node[node_index + 1].pos_y)
+        {
+            node[node_index].width += node[node_index + 1].width;
+
+            memmove(&node[node_index + 1], &node[node_index + 2], (size_t)(*node_count - node_index - 2) * sizeof(struct esz_atlas_node));
+            *node_count -= 1;
+        }
+        else
+        {
+            node_index += 1;
+        }
+    }
+}
@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: MIT
+/**
+ * @file    esz_atlas.h
+ * @brief   eszFW texture atlas packer
+ */
+
+#ifndef ESZ_ATLAS_H
+#define ESZ_ATLAS_H
+
+#include <SDL.h>
+
+#include "esz_types.h"
+
+esz_status add_atlas_image(SDL_Surface* surface, SDL_Texture** texture, int32_t* offset_x, int32_t* offset_y, esz_atlas_t* atlas);
+esz_status build_atlas(esz_atlas_t* atlas, esz_window_t* window);
+void       destroy_atlas(esz_atlas_t* atlas, esz_window_t* window);
+
+#endif // ESZ_ATLAS_H
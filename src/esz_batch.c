@@ -0,0 +1,420 @@
+// SPDX-License-Identifier: MIT
+/**
+ * @file    esz_batch.c
+ * @brief   eszFW sprite batching and render queue
+ * @details Quads that share the same texture are collected and
+ *          submitted with a single call to SDL_RenderGeometry().  If
+ *          SDL has been built without geometry support, each quad is
+ *          copied separately instead.
+ *
+ *          The render queue collects the draw commands of a frame and
+ *          sorts them by layer and texture before they are batched.
+ *          A command is only moved in front of commands it doesn't
+ *          overlap, so the result looks exactly like drawing in the
+ *          original order.  Overlaps are looked up on a coarse grid,
+ *          so sorting takes linear time in the number of commands.
+ */
+
+#include <picolog.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <SDL.h>
+
+#include "esz_batch.h"
+#include "esz_macros.h"
+#include "esz_types.h"
+
+static int                compare_commands(const void* command_a, const void* command_b);
+static esz_texture_run_t* get_texture_run(SDL_Texture* texture, esz_render_queue_t* queue);
+static esz_status         grow_batch(esz_batch_t* batch);
+static esz_status         grow_queue(esz_render_queue_t* queue);
+
+esz_status batch_quad(SDL_Texture* texture, const SDL_Rect* src, const SDL_Rect* dst, SDL_RendererFlip flip, esz_window_t* window)
+{
+    esz_batch_t*      batch = &window->batch;
+    esz_batch_quad_t* quad;
+
+    if (batch->texture != texture)
+    {
+        if (ESZ_OK != flush_batch(window))
+        {
+            return ESZ_ERROR_CRITICAL;
+        }
+        batch->texture = texture;
+    }
+
+    if (batch->quad_count >= batch->quad_capacity)
+    {
+        if (ESZ_OK != grow_batch(batch))
+        {
+            return ESZ_ERROR_CRITICAL;
+        }
+    }
+
+    quad       = &batch->quad[batch->quad_count];
+    quad->src  = *src;
+    quad->dst  = *dst;
+    quad->flip = flip;
+
+    batch->quad_count += 1;
+
+    return ESZ_OK;
+}
+
+void clear_queue(esz_window_t* window)
+{
+    window->queue.command_count = 0;
+    window->queue.layer_mask    = 0;
+}
+
+void destroy_batch(esz_window_t* window)
+{
+    free(window->batch.quad);
+    window->batch.quad = NULL;
+
+    #if SDL_VERSION_ATLEAST(2, 0, 18)
+    free(window->batch.vertex);
+    free(window->batch.index);
+    window->batch.vertex = NULL;
+    window->batch.index  = NULL;
+    #endif
+
+    window->batch.quad_capacity = 0;
+    window->batch.quad_count    = 0;
+    window->batch.texture       = NULL;
+
+    free(window->queue.command);
+    free(window->queue.texture_run);
+    window->queue.command              = NULL;
+    window->queue.texture_run          = NULL;
+    window->queue.command_capacity     = 0;
+    window->queue.texture_run_capacity = 0;
+
+    clear_queue(window);
+}
+
+esz_status flush_batch(esz_window_t* window)
+{
+    esz_batch_t* batch = &window->batch;
+
+    if (0 == batch->quad_count)
+    {
+        return ESZ_OK;
+    }
+
+    #if SDL_VERSION_ATLEAST(2, 0, 18)
+    if (! batch->is_geometry_unsupported)
+    {
+        int32_t texture_width;
+        int32_t texture_height;
+
+        if (0 > SDL_QueryTexture(batch->texture, NULL, NULL, &texture_width, &texture_height))
+        {
+            plog_error("%s: %s.", __func__, SDL_GetError());
+            return ESZ_ERROR_CRITICAL;
+        }
+
+        for (int32_t index = 0; index < batch->quad_count; index += 1)
+        {
+            esz_batch_quad_t* quad    = &batch->quad[index];
+            SDL_Vertex*       vertex  = &batch->vertex[index * 4];
+            int*              indices = &batch->index[index * 6];
+            float             u_a     = (float)quad->src.x                 / (float)texture_width;
+            float             u_b     = (float)(quad->src.x + quad->src.w) / (float)texture_width;
+            float             v_a     = (float)quad->src.y                 / (float)texture_height;
+            float             v_b     = (float)(quad->src.y + quad->src.h) / (float)texture_height;
+            float             x_a     = (float)quad->dst.x;
+            float             x_b     = (float)(quad->dst.x + quad->dst.w);
+            float             y_a     = (float)quad->dst.y;
+            float             y_b     = (float)(quad->dst.y + quad->dst.h);
+
+            if (quad->flip & SDL_FLIP_HORIZONTAL)
+            {
+                float u_tmp = u_a;
+                u_a         = u_b;
+                u_b         = u_tmp;
+            }
+
+            if (quad->flip & SDL_FLIP_VERTICAL)
+            {
+                float v_tmp = v_a;
+                v_a         = v_b;
+                v_b         = v_tmp;
+            }
+
+            for (int32_t corner = 0; corner < 4; corner += 1)
+            {
+                vertex[corner].color.r = 0xff;
+                vertex[corner].color.g = 0xff;
+                vertex[corner].color.b = 0xff;
+                vertex[corner].color.a = SDL_ALPHA_OPAQUE;
+            }
+
+            vertex[0].position.x  = x_a;
+            vertex[0].position.y  = y_a;
+            vertex[0].tex_coord.x = u_a;
+            vertex[0].tex_coord.y = v_a;
+            vertex[1].position.x  = x_b;
+            vertex[1].position.y  = y_a;
+            vertex[1].tex_coord.x = u_b;
+            vertex[1].tex_coord.y = v_a;
+            vertex[2].position.x  = x_a;
+            vertex[2].position.y  = y_b;
+            vertex[2].tex_coord.x = u_a;
+            vertex[2].tex_coord.y = v_b;
+            vertex[3].position.x  = x_b;
+            vertex[3].position.y  = y_b;
+            vertex[3].tex_coord.x = u_b;
+            vertex[3].tex_coord.y = v_b;
+
+            indices[0] = (index * 4);
+            indices[1] = (index * 4) + 1;
+            indices[2] = (index * 4) + 2;
+            indices[3] = (index * 4) + 2;
+            indices[4] = (index * 4) + 1;
+            indices[5] = (index * 4) + 3;
+        }
+
+        if (0 == SDL_RenderGeometry(window->renderer, batch->texture, batch->vertex, batch->quad_count * 4, batch->index, batch->quad_count * 6))
+        {
+            batch->quad_count = 0;
+            return ESZ_OK;
+        }
+
+        plog_warn("%s: %s: fall back to single copies.", __func__, SDL_GetError());
+        batch->is_geometry_unsupported = true;
+    }
+    #endif
+
+    for (int32_t index = 0; index < batch->quad_count; index += 1)
+    {
+        esz_batch_quad_t* quad = &batch->quad[index];
+
+        if (0 > SDL_RenderCopyEx(window->renderer, batch->texture, &quad->src, &quad->dst, 0, NULL, quad->flip))
+        {
+            plog_error("%s: %s.", __func__, SDL_GetError());
+            batch->quad_count = 0;
+            return ESZ_ERROR_CRITICAL;
+        }
+    }
+
+    batch->quad_count = 0;
+    return ESZ_OK;
+}
+
+void queue_layer(esz_render_layer layer, esz_window_t* window)
+{
+    SET_STATE(window->queue.layer_mask, (uint32_t)layer);
+}
+
+esz_status queue_quad(esz_render_layer layer, SDL_Texture* texture, const SDL_Rect* src, const SDL_Rect* dst, SDL_RendererFlip flip, esz_window_t* window)
+{
+    esz_render_queue_t*   queue = &window->queue;
+    esz_render_command_t* command;
+
+    if (queue->command_count >= queue->command_capacity)
+    {
+        if (ESZ_OK != grow_queue(queue))
+        {
+            return ESZ_ERROR_CRITICAL;
+        }
+    }
+
+    command          = &queue->command[queue->command_count];
+    command->src     = *src;
+    command->dst     = *dst;
+    command->flip    = flip;
+    command->texture = texture;
+    command->layer   = layer;
+    command->order   = queue->command_count;
+
+    queue->command_count += 1;
+
+    queue_layer(layer, window);
+
+    return ESZ_OK;
+}
+
+void sort_queue(esz_window_t* window)
+{
+    esz_render_queue_t* queue       = &window->queue;
+    int32_t             cell_width  = SDL_max(window->logical_width  / ESZ_RENDER_QUEUE_GRID, 1);
+    int32_t             cell_height = SDL_max(window->logical_height / ESZ_RENDER_QUEUE_GRID, 1);
+    int32_t             run_count   = 0;
+
+    /* Commands are grouped into runs of the same texture.  A command
+     * may join the latest run of its texture, as long as no command it
+     * overlaps has been put into a later run.  Each grid cell holds the
+     * latest run drawn to it, which errs on the safe side: commands
+     * that merely share a cell are treated as overlapping.
+     */
+    for (int32_t index = 0; index < queue->command_count; index += 1)
+    {
+        esz_render_command_t* command     = &queue->command[index];
+        esz_texture_run_t*    texture_run;
+        int32_t               lower_run   = 0;
+        int32_t               first_x     = SDL_max(SDL_min(command->dst.x / cell_width,  ESZ_RENDER_QUEUE_GRID - 1), 0);
+        int32_t               first_y     = SDL_max(SDL_min(command->dst.y / cell_height, ESZ_RENDER_QUEUE_GRID - 1), 0);
+        int32_t               last_x      = SDL_max(SDL_min((command->dst.x + command->dst.w - 1) / cell_width,  ESZ_RENDER_QUEUE_GRID - 1), 0);
+        int32_t               last_y      = SDL_max(SDL_min((command->dst.y + command->dst.h - 1) / cell_height, ESZ_RENDER_QUEUE_GRID - 1), 0);
+
+        if (0 == index || command->layer != queue->command[index - 1].layer)
+        {
+            SDL_memset(queue->cell_run, 0, sizeof(queue->cell_run));
+            SDL_memset(queue->texture_run, 0, (size_t)queue->texture_run_capacity * sizeof(struct esz_texture_run));
+            run_count = 0;
+        }
+
+        // Empty commands don't overlap anything.
+        if (0 >= command->dst.w || 0 >= command->dst.h)
+        {
+            last_x = first_x - 1;
+        }
+
+        texture_run = get_texture_run(command->texture, queue);
+
+        // The common case: same texture as the command before.
+        if (texture_run->texture && texture_run->run == run_count - 1)
+        {
+            lower_run = run_count - 1;
+        }
+        else
+        {
+            for (int32_t cell_y = first_y; cell_y <= last_y; cell_y += 1)
+            {
+                for (int32_t cell_x = first_x; cell_x <= last_x; cell_x += 1)
+                {
+                    lower_run = SDL_max(lower_run, queue->cell_run[(cell_y * ESZ_RENDER_QUEUE_GRID) + cell_x]);
+                }
+            }
+        }
+
+        if (texture_run->texture && texture_run->run >= lower_run)
+        {
+            command->sort_key = texture_run->run;
+        }
+        else
+        {
+            command->sort_key  = run_count;
+            run_count         += 1;
+        }
+
+        texture_run->texture = command->texture;
+        texture_run->run     = command->sort_key;
+
+        // No earlier command in these cells has a later run.
+        for (int32_t cell_y = first_y; cell_y <= last_y; cell_y += 1)
+        {
+            for (int32_t cell_x = first_x; cell_x <= last_x; cell_x += 1)
+            {
+                queue->cell_run[(cell_y * ESZ_RENDER_QUEUE_GRID) + cell_x] = command->sort_key;
+            }
+        }
+    }
+
+    qsort(queue->command, (size_t)queue->command_count, sizeof(struct esz_render_command), compare_commands);
+}
+
+static int compare_commands(const void* command_a, const void* command_b)
+{
+    const esz_render_command_t* a = (const esz_render_command_t*)command_a;
+    const esz_render_command_t* b = (const esz_render_command_t*)command_b;
+
+    if (a->layer != b->layer)
+    {
+        return (a->layer < b->layer) ? -1 : 1;
+    }
+
+    if (a->sort_key != b->sort_key)
+    {
+        return (a->sort_key < b->sort_key) ? -1 : 1;
+    }
+
+    // qsort() isn't stable, so the original order breaks ties.
+    return (a->order < b->order) ? -1 : (a->order > b->order);
+}
+
+static esz_texture_run_t* get_texture_run(SDL_Texture* texture, esz_render_queue_t* queue)
+{
+    uint32_t mask  = (uint32_t)queue->texture_run_capacity - 1;
+    uint32_t index = ((uint32_t)((uintptr_t)texture >> 4) * 2654435761u) & mask;
+
+    // There are at least twice as many slots as commands, so there's always a free one.
+    while (queue->texture_run[index].texture && queue->texture_run[index].texture != texture)
+    {
+        index = (index + 1) & mask;
+    }
+
+    return &queue->texture_run[index];
+}
+
+static esz_status grow_batch(esz_batch_t* batch)
+{
+    int32_t           quad_capacity = batch->quad_capacity ? batch->quad_capacity * 2 : 256;
+    esz_batch_quad_t* quad;
+
+    quad = (esz_batch_quad_t*)realloc(batch->quad, (size_t)quad_capacity * sizeof(struct esz_batch_quad));
+    if (! quad)
+    {
+        plog_error("%s: error allocating memory.", __func__);
+        return ESZ_ERROR_CRITICAL;
+    }
+    batch->quad = quad;
+
+    #if SDL_VERSION_ATLEAST(2, 0, 18)
+    {
+        SDL_Vertex* vertex;
+        int*        index;
+
+        vertex = (SDL_Vertex*)realloc(batch->vertex, (size_t)quad_capacity * 4 * sizeof(SDL_Vertex));
+        if (! vertex)
+        {
+            plog_error("%s: error allocating memory.", __func__);
+            return ESZ_ERROR_CRITICAL;
+        }
+        batch->vertex = vertex;
+
+        index = (int*)realloc(batch->index, (size_t)quad_capacity * 6 * sizeof(int));
+        if (! index)
+        {
+            plog_error("%s: error allocating memory.", __func__);
+            return ESZ_ERROR_CRITICAL;
+        }
+        batch->index = index;
+    }
+    #endif
+
+    batch->quad_capacity = quad_capacity;
+    return ESZ_OK;
+}
+
+static esz_status grow_queue(esz_render_queue_t* queue)
+{
+    int32_t               command_capacity = queue->command_capacity ? queue->command_capacity * 2 : 256;
+    esz_render_command_t* command;
+    esz_texture_run_t*    texture_run;
+
+    command = (esz_render_command_t*)realloc(queue->command, (size_t)command_capacity * sizeof(struct esz_render_command));
+    if (! command)
+    {
+        plog_error("%s: error allocating memory.", __func__);
+        return ESZ_ERROR_CRITICAL;
+    }
+
+    queue->command          = command;
+    queue->command_capacity = command_capacity;
+
+    // Twice the number of commands keeps the texture lookup short.
+    texture_run = (esz_texture_run_t*)realloc(queue->texture_run, (size_t)command_capacity * 2 * sizeof(struct esz_texture_run));
+    if (! texture_run)
+    {
+        plog_error("%s: error allocating memory.", __func__);
+        return ESZ_ERROR_CRITICAL;
+    }
+
+    queue->texture_run          = texture_run;
+    queue->texture_run_capacity = command_capacity * 2;
+
+    return ESZ_OK;
+}
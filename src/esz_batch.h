@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: MIT
+/**
+ * @file    esz_batch.h
+ * @brief   eszFW sprite batching and render queue
+ */
+
+#ifndef ESZ_BATCH_H
+#define ESZ_BATCH_H
+
+#include <SDL.h>
+
+#include "esz_types.h"
+
+esz_status batch_quad(SDL_Texture* texture, const SDL_Rect* src, const SDL_Rect* dst, SDL_RendererFlip flip, esz_window_t* window);
+void       clear_queue(esz_window_t* window);
+void       destroy_batch(esz_window_t* window);
+esz_status flush_batch(esz_window_t* window);
+void       queue_layer(esz_render_layer layer, esz_window_t* window);
+esz_status queue_quad(esz_render_layer layer, SDL_Texture* texture, const SDL_Rect* src, const SDL_Rect* dst, SDL_RendererFlip flip, esz_window_t* window);
+void       sort_queue(esz_window_t* window);
+
+#endif // ESZ_BATCH_H
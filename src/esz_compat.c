@@ -37,6 +37,8 @@ DISABLE_WARNING_POP
 
 #ifdef USE_LIBTMX
 static void tmxlib_store_property(esz_tiled_property_t* property, void* core);
+#else // (cute_tiled.h)
+static esz_tiled_tileset_t* cutetiled_find_tileset(int32_t gid, esz_tiled_map_t* tiled_map);
 #endif
 
 int32_t get_first_gid(esz_tiled_map_t* tiled_map)
@@ -130,9 +132,15 @@ int32_t get_local_id(int32_t gid, esz_tiled_map_t* tiled_map)
     return gid;
 
     #else // (cute_tiled.h)
-    int32_t local_id = gid - get_first_gid(tiled_map);
+    esz_tiled_tileset_t* tileset  = cutetiled_find_tileset(gid, tiled_map);
+    int32_t              local_id = 0;
+
+    if (tileset)
+    {
+        local_id = gid - tileset->firstgid;
+    }
 
-    return local_id >= 0 ? local_id : 0;
+    return local_id;
 
     #endif
 }
@@ -155,11 +163,13 @@ int32_t get_next_animated_tile_id(int32_t gid, int32_t current_frame, esz_tiled_
     return (int32_t)tiled_map->tiles[gid]->animation[current_frame].tile_id;
 
     #else // (cute_tiled.h)
-    esz_tiled_tileset_t*          tileset = get_head_tileset(tiled_map);
-    cute_tiled_tile_descriptor_t* tile    = tileset->tiles;
+    esz_tiled_tileset_t*          tileset  = cutetiled_find_tileset(gid, tiled_map);
+    cute_tiled_tile_descriptor_t* tile     = tileset ? tileset->tiles : NULL;
+    int32_t                       local_id = get_local_id(gid, tiled_map);
+
     while (tile)
     {
-        if (tile->tile_index == gid)
+        if (tile->tile_index == local_id)
         {
             return tile->animation[current_frame].tileid;
         }
@@ -205,6 +215,27 @@ const char* get_object_type_name(esz_tiled_object_t* tiled_object)
     #endif
 }
 
+int32_t get_tile_count(esz_tiled_map_t* tiled_map)
+{
+    #ifdef USE_LIBTMX
+    return (int32_t)tiled_map->tilecount;
+
+    #else // (cute_tiled.h)
+    esz_tiled_tileset_t* tileset    = tiled_map->tilesets;
+    int32_t              tile_count = 0;
+
+    // Including the unused gid 0.
+    while (tileset)
+    {
+        tile_count = SDL_max(tile_count, tileset->firstgid + tileset->tilecount);
+        tileset    = tileset->next;
+    }
+
+    return tile_count;
+
+    #endif
+}
+
 int32_t get_tile_height(esz_tiled_map_t* tiled_map)
 {
     #ifdef USE_LIBTMX
@@ -224,11 +255,18 @@ void get_tile_position(int32_t gid, int32_t* pos_x, int32_t* pos_y, esz_tiled_ma
     *pos_y = (int32_t)tiled_map->tiles[gid]->ul_y;
 
     #else // (cute_tiled.h)
-    esz_tiled_tileset_t* tileset  = tiled_map->tilesets;
+    esz_tiled_tileset_t* tileset  = cutetiled_find_tileset(gid, tiled_map);
     int32_t              local_id = get_local_id(gid, tiled_map);
 
-    *pos_x = (local_id % tileset->columns) * get_tile_width(tiled_map);
-    *pos_y = (local_id / tileset->columns) * get_tile_height(tiled_map);
+    if (! tileset || 0 >= tileset->columns)
+    {
+        *pos_x = 0;
+        *pos_y = 0;
+        return;
+    }
+
+    *pos_x = (local_id % tileset->columns) * tileset->tilewidth;
+    *pos_y = (local_id / tileset->columns) * tileset->tileheight;
 
     #endif
 }
@@ -257,14 +295,24 @@ int32_t get_tile_width(esz_tiled_map_t* tiled_map)
     #endif
 }
 
-void set_tileset_path(char* path_name, int32_t path_length, esz_core_t* core)
+void set_tileset_path(char* path_name, int32_t path_length, int32_t tileset_index, esz_core_t* core)
 {
     #ifdef USE_LIBTMX
-    int32_t first_gid      = get_first_gid(core->map->handle);
-    char    ts_path[64]    = { 0 };
-    size_t  ts_path_length = 0;
+    tmx_tileset_list* tileset_list   = core->map->handle->ts_head;
+    char              ts_path[64]    = { 0 };
+    size_t            ts_path_length = 0;
 
-    cwk_path_get_dirname(core->map->handle->ts_head->source, &ts_path_length);
+    for (int32_t index = 0; index < tileset_index && tileset_list; index += 1)
+    {
+        tileset_list = tileset_list->next;
+    }
+
+    if (! tileset_list)
+    {
+        return;
+    }
+
+    cwk_path_get_dirname(tileset_list->source, &ts_path_length);
 
     if (63 <= ts_path_length)
     {
@@ -277,43 +325,135 @@ void set_tileset_path(char* path_name, int32_t path_length, esz_core_t* core)
      * accordingly.  It's a hack, but it works.
      */
 
-    SDL_strlcpy(ts_path, core->map->handle->ts_head->source, ts_path_length + 1);
+    SDL_strlcpy(ts_path, tileset_list->source, ts_path_length + 1);
     stbsp_snprintf(path_name, (int32_t)path_length, "%s%s%s",
         core->map->path,
         ts_path,
-        core->map->handle->tiles[first_gid]->tileset->image->source);
+        tileset_list->tileset->image->source);
 
     #else // (cute_tiled.h)
+    esz_tiled_tileset_t* tileset = core->map->handle->tilesets;
+
+    for (int32_t index = 0; index < tileset_index && tileset; index += 1)
+    {
+        tileset = tileset->next;
+    }
+
+    if (! tileset)
+    {
+        return;
+    }
+
     stbsp_snprintf(path_name, (int32_t)path_length, "%s%s",
         core->map->path,
-        core->map->handle->tilesets->image.ptr);
+        tileset->image.ptr);
+
+    #endif
+}
+
+int32_t get_tileset_count(esz_tiled_map_t* tiled_map)
+{
+    int32_t tileset_count = 0;
+
+    #ifdef USE_LIBTMX
+    tmx_tileset_list* tileset = tiled_map->ts_head;
+
+    #else // (cute_tiled.h)
+    esz_tiled_tileset_t* tileset = tiled_map->tilesets;
 
     #endif
+
+    while (tileset)
+    {
+        tileset_count += 1;
+        tileset        = tileset->next;
+    }
+
+    return tileset_count;
 }
 
-int32_t get_tileset_path_length(esz_core_t* core)
+int32_t get_tileset_index(int32_t gid, esz_tiled_map_t* tiled_map)
+{
+    int32_t tileset_index = 0;
+
+    #ifdef USE_LIBTMX
+    tmx_tileset_list* tileset = tiled_map->ts_head;
+
+    if (0 >= gid || gid >= (int32_t)tiled_map->tilecount || ! tiled_map->tiles[gid])
+    {
+        return -1;
+    }
+
+    while (tileset)
+    {
+        if (tileset->tileset == tiled_map->tiles[gid]->tileset)
+        {
+            return tileset_index;
+        }
+        tileset_index += 1;
+        tileset        = tileset->next;
+    }
+
+    #else // (cute_tiled.h)
+    esz_tiled_tileset_t* tileset = tiled_map->tilesets;
+    esz_tiled_tileset_t* owner   = cutetiled_find_tileset(gid, tiled_map);
+
+    while (tileset && owner)
+    {
+        if (tileset == owner)
+        {
+            return tileset_index;
+        }
+        tileset_index += 1;
+        tileset        = tileset->next;
+    }
+
+    #endif
+
+    return -1;
+}
+
+int32_t get_tileset_path_length(int32_t tileset_index, esz_core_t* core)
 {
     int32_t path_length = 0;
 
     #ifdef USE_LIBTMX
-    int32_t first_gid      = get_first_gid(core->map->handle);
-    size_t  ts_path_length = 0;
+    tmx_tileset_list* tileset_list   = core->map->handle->ts_head;
+    size_t            ts_path_length = 0;
+
+    for (int32_t index = 0; index < tileset_index && tileset_list; index += 1)
+    {
+        tileset_list = tileset_list->next;
+    }
+
+    if (! tileset_list)
+    {
+        plog_error("%s: tileset %d not found.", __func__, tileset_index);
+        return 0;
+    }
 
-    cwk_path_get_dirname(core->map->handle->ts_head->source, &ts_path_length);
+    cwk_path_get_dirname(tileset_list->source, &ts_path_length);
 
     path_length += (int32_t)strnlen(core->map->path, 64);
-    path_length += strnlen(core->map->handle->tiles[first_gid]->tileset->image->source, 64);
+    path_length += strnlen(tileset_list->tileset->image->source, 64);
     path_length += (int32_t)ts_path_length + 1;
 
     #else // (cute_tiled.h)
-    if (! core->map->handle->tilesets)
+    esz_tiled_tileset_t* tileset = core->map->handle->tilesets;
+
+    for (int32_t index = 0; index < tileset_index && tileset; index += 1)
+    {
+        tileset = tileset->next;
+    }
+
+    if (! tileset)
     {
         plog_error("%s: no embedded tileset found.", __func__);
         return 0;
     }
 
     path_length += (int32_t)strnlen(core->map->path, 64);
-    path_length += (int32_t)strnlen(core->map->handle->tilesets->image.ptr, 64);
+    path_length += (int32_t)strnlen(tileset->image.ptr, 64);
     path_length += 1;
 
     #endif
@@ -362,8 +502,8 @@ bool is_tile_animated(int32_t gid, int32_t* animation_length, int32_t* id, esz_t
     }
 
     #else // (cute_tiled.h)
-    esz_tiled_tileset_t* tileset = tiled_map->tilesets;
-    esz_tiled_tile_t*    tile    = tileset->tiles;
+    esz_tiled_tileset_t* tileset = cutetiled_find_tileset(gid, tiled_map);
+    esz_tiled_tile_t*    tile    = tileset ? tileset->tiles : NULL;
 
     while (tile)
     {
@@ -554,7 +694,11 @@ bool tile_has_properties(int32_t gid, esz_tiled_tile_t** tile, esz_tiled_map_t*
     return true;
 
     #else // (cute_tiled.h)
-    local_id = gid - get_first_gid(tiled_map);
+    esz_tiled_tileset_t* tileset = cutetiled_find_tileset(gid, tiled_map);
+
+    // The tile descriptors are looked up in the tileset owning the gid.
+    local_id = get_local_id(gid, tiled_map);
+    (*tile)  = tileset ? tileset->tiles : NULL;
 
     while ((*tile))
     {
@@ -633,3 +777,21 @@ static void tmxlib_store_property(esz_tiled_property_t* property, void* core)
     }
 }
 #endif
+
+#ifndef USE_LIBTMX
+static esz_tiled_tileset_t* cutetiled_find_tileset(int32_t gid, esz_tiled_map_t* tiled_map)
+{
+    esz_tiled_tileset_t* tileset = tiled_map->tilesets;
+
+    while (tileset)
+    {
+        if (gid >= tileset->firstgid && gid < tileset->firstgid + tileset->tilecount)
+        {
+            return tileset;
+        }
+        tileset = tileset->next;
+    }
+
+    return NULL;
+}
+#endif
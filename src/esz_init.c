@@ -29,38 +29,68 @@ DISABLE_WARNING_SYMBOL_NOT_DEFINED
 
 DISABLE_WARNING_POP
 
+#include "esz_atlas.h"
 #include "esz_compat.h"
 #include "esz_hash.h"
 #include "esz_init.h"
+#include "esz_texture.h"
 #include "esz_types.h"
 #include "esz_utils.h"
 
-static esz_status load_background_layer(int32_t index, esz_window_t* window, esz_core_t* core);
+static esz_draw_layer_t* add_draw_layer(esz_draw_layer_type type, esz_render_layer render_layer, esz_core_t* core);
+static void             add_fixed_draw_layers(esz_core_t* core);
+static void             add_tiled_draw_layers(esz_core_t* core);
+static esz_status       load_background_layer(int32_t index, esz_window_t* window, esz_core_t* core);
+static esz_status       load_tile_animation(int32_t gid, int32_t frame_count, int32_t* animation, esz_core_t* core);
+static esz_status       load_tile_opacity(SDL_Surface* surface, int32_t tileset_index, esz_core_t* core);
 
 esz_status load_animated_tiles(esz_core_t* core)
 {
-    esz_tiled_layer_t* layer               = get_head_layer(core->map->handle);
+    esz_tiled_layer_t* layer;
     int32_t            animated_tile_count = 0;
+    int32_t            chunk_count         = core->map->chunk_count_x * core->map->chunk_count_y;
+    int32_t            layer_index         = 0;
+    int32_t            tile_width          = get_tile_width(core->map->handle);
+    int32_t            tile_height         = get_tile_height(core->map->handle);
 
+    if (! core->map->tile_layer_index || ! core->map->chunk_animated_tile_overlay)
+    {
+        return ESZ_OK;
+    }
+
+    /* Remark: animated tiles are collected from every tile layer that
+     * is drawn.  The tiles are grouped by chunk and map level so that
+     * each chunk can update the animated tiles of a map level in one
+     * go, right on top of it.
+     */
+    layer = get_head_layer(core->map->handle);
     while (layer)
     {
-        if (is_tiled_layer_of_type(ESZ_TILE_LAYER, layer, core) && layer->visible)
+        if (is_tile_layer_animated(layer_index, core))
         {
-            for (int32_t index_height = 0; index_height < (int32_t)core->map->handle->height; index_height += 1)
+            esz_tile_layer_index_t* tile_layer_index = &core->map->tile_layer_index[layer_index];
+            int32_t*                layer_content    = get_layer_content(layer);
+            int32_t                 level            = core->map->tile_layer_level[layer_index];
+
+            for (int32_t chunk_index = 0; chunk_index < chunk_count; chunk_index += 1)
             {
-                for (int32_t index_width = 0; index_width < (int32_t)core->map->handle->width; index_width += 1)
+                for (int32_t index = tile_layer_index->chunk_offset[chunk_index]; index < tile_layer_index->chunk_offset[chunk_index + 1]; index += 1)
                 {
-                    int32_t* layer_content = get_layer_content(layer);
-                    int32_t  gid           = remove_gid_flip_bits((int32_t)layer_content[(index_height * (int32_t)core->map->handle->width) + index_width]);
+                    int32_t gid              = remove_gid_flip_bits((int32_t)layer_content[tile_layer_index->cell[index]]);
+                    int32_t animation_length = 0;
 
-                    if (is_tile_animated(gid, NULL, NULL, core->map->handle))
+                    if (is_tile_animated(gid, &animation_length, NULL, core->map->handle) && 0 < animation_length)
                     {
-                        animated_tile_count += 1;
+                        core->map->chunk[chunk_index].animated_tile_overlay[level].tile_count += 1;
+                        animated_tile_count                                                   += 1;
+
+                        SET_STATE(core->map->animated_render_layers, (uint32_t)core->map->level_render_layer[level]);
                     }
                 }
             }
         }
-        layer = layer->next;
+        layer_index += 1;
+        layer        = layer->next;
     }
 
     if (0 >= animated_tile_count)
@@ -77,7 +107,87 @@ esz_status load_animated_tiles(esz_core_t* core)
         }
     }
 
-    plog_info("Load %u animated tile(s).", animated_tile_count);
+    animated_tile_count = 0;
+    for (int32_t index = 0; index < chunk_count * core->map->level_count; index += 1)
+    {
+        esz_tile_overlay_t* overlay = &core->map->chunk_animated_tile_overlay[index];
+
+        overlay->tile_offset  = animated_tile_count;
+        animated_tile_count  += overlay->tile_count;
+        overlay->tile_count   = 0;
+    }
+
+    for (int32_t chunk_index = 0; chunk_index < chunk_count; chunk_index += 1)
+    {
+        esz_map_chunk_t*     chunk = &core->map->chunk[chunk_index];
+        esz_animated_tile_t* animated_tile;
+
+        layer       = get_head_layer(core->map->handle);
+        layer_index = 0;
+        while (layer)
+        {
+            if (is_tile_layer_animated(layer_index, core))
+            {
+                esz_tile_layer_index_t* tile_layer_index = &core->map->tile_layer_index[layer_index];
+                esz_tile_overlay_t*     overlay          = &chunk->animated_tile_overlay[core->map->tile_layer_level[layer_index]];
+                int32_t*                layer_content    = get_layer_content(layer);
+
+                for (int32_t index = tile_layer_index->chunk_offset[chunk_index]; index < tile_layer_index->chunk_offset[chunk_index + 1]; index += 1)
+                {
+                    int32_t tile_index       = tile_layer_index->cell[index];
+                    int32_t gid              = remove_gid_flip_bits((int32_t)layer_content[tile_index]);
+                    int32_t animation_length = 0;
+
+                    if (is_tile_animated(gid, &animation_length, NULL, core->map->handle) && 0 < animation_length)
+                    {
+                        animated_tile = &core->map->animated_tile[overlay->tile_offset + overlay->tile_count];
+
+                        if (ESZ_OK != load_tile_animation(gid, animation_length, &animated_tile->animation, core))
+                        {
+                            return ESZ_ERROR_CRITICAL;
+                        }
+
+                        animated_tile->dst_x         = (tile_index % (int32_t)core->map->handle->width) * tile_width;
+                        animated_tile->dst_y         = (tile_index / (int32_t)core->map->handle->width) * tile_height;
+                        animated_tile->current_frame = 0;
+
+                        overlay->tile_count += 1;
+                    }
+                }
+            }
+            layer_index += 1;
+            layer        = layer->next;
+        }
+
+        /* Tiles stacked on the same position are stored next to each
+         * other in layer order, so that a single cell can be cleared
+         * and redrawn once one of its tiles advances to the next
+         * frame.  The insertion sort is stable and keeps the layer
+         * order within a cell.
+         */
+        for (int32_t level = 0; level < core->map->level_count; level += 1)
+        {
+            esz_tile_overlay_t* overlay = &chunk->animated_tile_overlay[level];
+
+            animated_tile = &core->map->animated_tile[overlay->tile_offset];
+            for (int32_t index = 1; index < overlay->tile_count; index += 1)
+            {
+                esz_animated_tile_t current = animated_tile[index];
+                int32_t             target  = index;
+
+                while (0 < target && (animated_tile[target - 1].dst_y > current.dst_y || (animated_tile[target - 1].dst_y == current.dst_y && animated_tile[target - 1].dst_x > current.dst_x)))
+                {
+                    animated_tile[target] = animated_tile[target - 1];
+                    target               -= 1;
+                }
+                animated_tile[target] = current;
+            }
+        }
+    }
+
+    core->map->animated_tile_index = animated_tile_count;
+
+    plog_info("Load %u animated tile(s) sharing %d animation(s).", animated_tile_count, core->map->tile_animation_count);
     return ESZ_OK;
 }
 
@@ -149,10 +259,108 @@ esz_status load_background(esz_window_t* window, esz_core_t* core)
     return ESZ_OK;
 }
 
+esz_status load_draw_order(esz_core_t* core)
+{
+    esz_tiled_layer_t* layer;
+    int32_t            draw_entity_count = 0;
+    int32_t            layer_index;
+    bool               is_in_foreground  = false;
+
+    /* Each layer adds at most one entry to the draw order and at most
+     * one map level, and so does each render layer.
+     */
+    core->map->draw_layer         = (esz_draw_layer_t*)calloc((size_t)core->map->layer_count + ESZ_RENDER_LAYER_MAX, sizeof(struct esz_draw_layer));
+    core->map->level_render_layer = (esz_render_layer*)calloc((size_t)core->map->layer_count + ESZ_RENDER_LAYER_MAX, sizeof(esz_render_layer));
+
+    if (! core->map->draw_layer || ! core->map->level_render_layer)
+    {
+        plog_error("%s: error allocating memory.", __func__);
+        return ESZ_ERROR_CRITICAL;
+    }
+
+    if (0 < core->map->layer_count)
+    {
+        core->map->tile_layer_level = (int32_t*)malloc((size_t)core->map->layer_count * sizeof(int32_t));
+        if (! core->map->tile_layer_level)
+        {
+            plog_error("%s: error allocating memory.", __func__);
+            return ESZ_ERROR_CRITICAL;
+        }
+
+        for (layer_index = 0; layer_index < core->map->layer_count; layer_index += 1)
+        {
+            core->map->tile_layer_level[layer_index] = -1;
+        }
+    }
+
+    // Maps that place tile layers by property keep doing so.
+    layer = get_head_layer(core->map->handle);
+    while (layer)
+    {
+        if (is_tiled_layer_of_type(ESZ_TILE_LAYER, layer, core) && layer->visible)
+        {
+            if (get_boolean_property(H_is_in_foreground, layer->properties, get_layer_property_count(layer), core))
+            {
+                is_in_foreground = true;
+            }
+        }
+        layer = layer->next;
+    }
+
+    if (is_in_foreground)
+    {
+        add_fixed_draw_layers(core);
+    }
+    else
+    {
+        add_tiled_draw_layers(core);
+    }
+
+    /* An actor may be selected by the state of more than one entry;
+     * the entry of an object group only lists the group's actors.
+     */
+    for (int32_t index = 0; index < core->map->draw_layer_count; index += 1)
+    {
+        esz_draw_layer_t* draw_layer = &core->map->draw_layer[index];
+
+        if (ESZ_DRAW_ACTORS != draw_layer->type)
+        {
+            continue;
+        }
+
+        if (0 > draw_layer->layer_index)
+        {
+            draw_entity_count += core->map->entity_count;
+        }
+        else
+        {
+            draw_entity_count += draw_layer->entity_count;
+        }
+    }
+
+    if (0 < draw_entity_count)
+    {
+        core->map->draw_entity = (int32_t*)calloc((size_t)draw_entity_count, sizeof(int32_t));
+        if (! core->map->draw_entity)
+        {
+            plog_error("%s: error allocating memory.", __func__);
+            return ESZ_ERROR_CRITICAL;
+        }
+
+        update_actor_draw_layers(core);
+    }
+
+    plog_info("Flatten %d layer(s) into %d draw layer(s) with %d map level(s).", core->map->layer_count, core->map->draw_layer_count, core->map->level_count);
+
+    return ESZ_OK;
+}
+
 esz_status load_entities(esz_core_t* core)
 {
     esz_tiled_layer_t*  layer         = get_head_layer(core->map->handle);
     esz_tiled_object_t* tiled_object  = NULL;
+    int32_t             index         = 0;
+    int32_t             layer_index   = 0;
     bool                player_found  = false;
 
     if (core->map->entity_count)
@@ -191,8 +399,7 @@ esz_status load_entities(esz_core_t* core)
     {
         if (is_tiled_layer_of_type(ESZ_OBJECT_GROUP, layer, core))
         {
-            int32_t index = 0;
-            tiled_object  = get_head_object(layer, core);
+            tiled_object = get_head_object(layer, core);
             while (tiled_object)
             {
                 uint64_t              type_hash  = generate_hash((const unsigned char*)get_object_type_name(tiled_object));
@@ -200,8 +407,9 @@ esz_status load_entities(esz_core_t* core)
                 esz_tiled_property_t* properties = tiled_object->properties;
                 int32_t               prop_cnt   = get_object_property_count(tiled_object);
 
-                entity->pos_x = (double)tiled_object->x;
-                entity->pos_y = (double)tiled_object->y;
+                entity->pos_x       = (double)tiled_object->x;
+                entity->pos_y       = (double)tiled_object->y;
+                entity->layer_index = layer_index;
 
                 switch (type_hash)
                 {
@@ -367,7 +575,8 @@ esz_status load_entities(esz_core_t* core)
                 tiled_object  = tiled_object->next;
             }
         }
-        layer = layer->next;
+        layer_index += 1;
+        layer        = layer->next;
     }
 
     if (! player_found)
@@ -378,6 +587,66 @@ esz_status load_entities(esz_core_t* core)
     return ESZ_OK;
 }
 
+esz_status load_map_chunks(esz_core_t* core)
+{
+    // The chunk grid has already been laid out by load_tile_layer_index().
+    int32_t chunk_count = core->map->chunk_count_x * core->map->chunk_count_y;
+    int32_t map_width   = (int32_t)core->map->handle->width  * get_tile_width(core->map->handle);
+    int32_t map_height  = (int32_t)core->map->handle->height * get_tile_height(core->map->handle);
+
+    if (0 >= chunk_count)
+    {
+        return ESZ_OK;
+    }
+
+    core->map->chunk = (esz_map_chunk_t*)calloc((size_t)chunk_count, sizeof(struct esz_map_chunk));
+    if (! core->map->chunk)
+    {
+        plog_error("%s: error allocating memory.", __func__);
+        return ESZ_ERROR_CRITICAL;
+    }
+
+    /* Each chunk has one texture per map level, plus its downsampled
+     * copies and the overlay of its animated tiles.
+     */
+    if (0 < core->map->level_count)
+    {
+        core->map->chunk_layer_texture         = (SDL_Texture**)calloc((size_t)chunk_count * (size_t)core->map->level_count, sizeof(SDL_Texture*));
+        core->map->chunk_mip_texture           = (SDL_Texture**)calloc((size_t)chunk_count * (size_t)core->map->level_count * ESZ_MAP_CHUNK_MIP_MAX, sizeof(SDL_Texture*));
+        core->map->chunk_animated_tile_overlay = (esz_tile_overlay_t*)calloc((size_t)chunk_count * (size_t)core->map->level_count, sizeof(struct esz_tile_overlay));
+
+        if (! core->map->chunk_layer_texture || ! core->map->chunk_mip_texture || ! core->map->chunk_animated_tile_overlay)
+        {
+            plog_error("%s: error allocating memory.", __func__);
+            return ESZ_ERROR_CRITICAL;
+        }
+    }
+
+    for (int32_t index_height = 0; index_height < core->map->chunk_count_y; index_height += 1)
+    {
+        for (int32_t index_width = 0; index_width < core->map->chunk_count_x; index_width += 1)
+        {
+            int32_t          chunk_index = (index_height * core->map->chunk_count_x) + index_width;
+            esz_map_chunk_t* chunk       = &core->map->chunk[chunk_index];
+
+            chunk->pos_x  = index_width  * ESZ_MAP_CHUNK_SIZE;
+            chunk->pos_y  = index_height * ESZ_MAP_CHUNK_SIZE;
+            chunk->width  = SDL_min(ESZ_MAP_CHUNK_SIZE, map_width  - chunk->pos_x);
+            chunk->height = SDL_min(ESZ_MAP_CHUNK_SIZE, map_height - chunk->pos_y);
+
+            if (core->map->chunk_layer_texture)
+            {
+                chunk->layer_texture         = &core->map->chunk_layer_texture[chunk_index * core->map->level_count];
+                chunk->mip_texture           = &core->map->chunk_mip_texture[chunk_index * core->map->level_count * ESZ_MAP_CHUNK_MIP_MAX];
+                chunk->animated_tile_overlay = &core->map->chunk_animated_tile_overlay[chunk_index * core->map->level_count];
+            }
+        }
+    }
+
+    plog_info("Split map into %dx%d chunk(s).", core->map->chunk_count_x, core->map->chunk_count_y);
+    return ESZ_OK;
+}
+
 esz_status load_map_path(const char* map_file_name, esz_core_t* core)
 {
     core->map->path = (char*)calloc(1, (size_t)(strnlen(map_file_name, 64) + 1));
@@ -393,7 +662,7 @@ esz_status load_map_path(const char* map_file_name, esz_core_t* core)
     return ESZ_OK;
 }
 
-esz_status load_sprites(esz_window_t* window, esz_core_t* core)
+esz_status load_sprites(esz_core_t* core)
 {
     char    property_name[17] = { 0 };
     bool    search_is_running = true;
@@ -435,8 +704,9 @@ esz_status load_sprites(esz_window_t* window, esz_core_t* core)
 
         if (file_name)
         {
-            int32_t source_length             = (int32_t)(strnlen(core->map->path, 64) + strnlen(file_name, 64) + 1);
-            char*   sprite_sheet_image_source = (char*)calloc(1, source_length);
+            SDL_Surface* surface                   = NULL;
+            int32_t      source_length             = (int32_t)(strnlen(core->map->path, 64) + strnlen(file_name, 64) + 1);
+            char*        sprite_sheet_image_source = (char*)calloc(1, source_length);
             if (! sprite_sheet_image_source)
             {
                 plog_error("%s: error allocating memory.", __func__);
@@ -447,7 +717,13 @@ esz_status load_sprites(esz_window_t* window, esz_core_t* core)
 
             core->map->sprite[index].id = index + 1;
 
-            if (ESZ_ERROR_CRITICAL == load_texture_from_file(sprite_sheet_image_source, &core->map->sprite[index].texture, window))
+            if (ESZ_ERROR_CRITICAL == load_surface_from_file(sprite_sheet_image_source, &surface))
+            {
+                free(sprite_sheet_image_source);
+                return ESZ_ERROR_CRITICAL;
+            }
+
+            if (ESZ_OK != add_atlas_image(surface, &core->map->sprite[index].texture, &core->map->sprite[index].offset_x, &core->map->sprite[index].offset_y, &core->map->atlas))
             {
                 free(sprite_sheet_image_source);
                 return ESZ_ERROR_CRITICAL;
@@ -460,93 +736,339 @@ esz_status load_sprites(esz_window_t* window, esz_core_t* core)
     return ESZ_OK;
 }
 
-esz_status load_tile_properties(esz_core_t* core)
+esz_status load_surface_from_file(const char* file_name, SDL_Surface** surface)
 {
-    esz_tiled_layer_t* layer      = get_head_layer(core->map->handle);
-    int32_t            tile_count = (int32_t)(core->map->handle->height * core->map->handle->width);
+    SDL_Surface*   image;
+    int            width;
+    int            height;
+    int            orig_format;
+    unsigned char* data;
 
-    core->map->tile_properties = (uint32_t*)calloc((size_t)tile_count, sizeof(uint32_t));
-    if (! core->map->tile_properties)
+    if (! file_name)
     {
-        plog_error("%s: error allocating memory.", __func__);
         return ESZ_WARNING;
     }
 
+    data = stbi_load(file_name, &width, &height, &orig_format, STBI_rgb_alpha);
+
+    if (NULL == data)
+    {
+        plog_error("%s: %s.", __func__, stbi_failure_reason());
+        return ESZ_ERROR_CRITICAL;
+    }
+
+    image = SDL_CreateRGBSurfaceWithFormatFrom((void*)data, width, height, 32, 4 * width, SDL_PIXELFORMAT_RGBA32);
+
+    if (NULL == image)
+    {
+        plog_error("%s: %s.", __func__, SDL_GetError());
+        stbi_image_free(data);
+        return ESZ_ERROR_CRITICAL;
+    }
+
+    // Copy the pixels, so that the surface outlives the decoded image.
+    *surface = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_RGBA32, 0);
+
+    SDL_FreeSurface(image);
+    stbi_image_free(data);
+
+    if (NULL == *surface)
+    {
+        plog_error("%s: %s.", __func__, SDL_GetError());
+        return ESZ_ERROR_CRITICAL;
+    }
+
+    plog_info("Loading image from file: %s.", file_name);
+    return ESZ_OK;
+}
+
+esz_status load_tile_layer_index(esz_core_t* core)
+{
+    esz_tiled_layer_t* layer       = get_head_layer(core->map->handle);
+    int32_t            chunk_count;
+    int32_t            map_width   = (int32_t)core->map->handle->width  * get_tile_width(core->map->handle);
+    int32_t            map_height  = (int32_t)core->map->handle->height * get_tile_height(core->map->handle);
+    int32_t            cell_count  = 0;
+    int32_t            layer_index = 0;
+
+    core->map->chunk_count_x = (map_width  + ESZ_MAP_CHUNK_SIZE - 1) / ESZ_MAP_CHUNK_SIZE;
+    core->map->chunk_count_y = (map_height + ESZ_MAP_CHUNK_SIZE - 1) / ESZ_MAP_CHUNK_SIZE;
+    chunk_count              = core->map->chunk_count_x * core->map->chunk_count_y;
+
+    core->map->layer_count = 0;
+    while (layer)
+    {
+        core->map->layer_count += 1;
+        layer = layer->next;
+    }
+
+    if (0 >= core->map->layer_count || 0 >= chunk_count)
+    {
+        return ESZ_OK;
+    }
+
+    /* Remark: the index is kept by layer position so that it can be
+     * walked alongside the layer list.  Layers that are not tile
+     * layers simply have no cells.
+     */
+    core->map->tile_layer_index = (esz_tile_layer_index_t*)calloc((size_t)core->map->layer_count, sizeof(struct esz_tile_layer_index));
+    if (! core->map->tile_layer_index)
+    {
+        plog_error("%s: error allocating memory.", __func__);
+        return ESZ_ERROR_CRITICAL;
+    }
+
+    layer = get_head_layer(core->map->handle);
     while (layer)
     {
+        esz_tile_layer_index_t* tile_layer_index = &core->map->tile_layer_index[layer_index];
+
+        tile_layer_index->chunk_offset = (int32_t*)calloc((size_t)chunk_count + 1, sizeof(int32_t));
+        if (! tile_layer_index->chunk_offset)
+        {
+            plog_error("%s: error allocating memory.", __func__);
+            return ESZ_ERROR_CRITICAL;
+        }
+
         if (is_tiled_layer_of_type(ESZ_TILE_LAYER, layer, core))
         {
+            int32_t* layer_content = get_layer_content(layer);
+            int32_t  offset        = 0;
+
+            // Count the occupied cells of each chunk.
             for (int32_t index_height = 0; index_height < (int32_t)core->map->handle->height; index_height += 1)
             {
                 for (int32_t index_width = 0; index_width < (int32_t)core->map->handle->width; index_width += 1)
                 {
-                    esz_tiled_tileset_t* tileset       = get_head_tileset(core->map->handle);
-                    esz_tiled_tile_t*    tile          = tileset->tiles;
-                    int32_t*             layer_content = get_layer_content(layer);
-                    int32_t              gid           = remove_gid_flip_bits((int32_t)layer_content[(index_height * (int32_t)core->map->handle->width) + index_width]);
-                    int32_t              tile_index    = (index_width + 1) * (index_height + 1);
+                    int32_t gid = remove_gid_flip_bits((int32_t)layer_content[(index_height * (int32_t)core->map->handle->width) + index_width]);
 
-                    if (tile_has_properties(gid, &tile, core->map->handle))
+                    if (is_gid_valid(gid, core->map->handle))
                     {
-                        int32_t prop_cnt  = get_tile_property_count(tile);
+                        tile_layer_index->chunk_offset[get_tile_chunk_index(index_width, index_height, core) + 1] += 1;
+                        tile_layer_index->cell_count += 1;
+                    }
+                }
+            }
 
-                        if (get_boolean_property(H_climbable, tile->properties, prop_cnt, core))
-                        {
-                            SET_STATE(core->map->tile_properties[tile_index], TILE_CLIMBABLE);
-                        }
+            if (0 < tile_layer_index->cell_count)
+            {
+                tile_layer_index->cell = (int32_t*)calloc((size_t)tile_layer_index->cell_count, sizeof(int32_t));
+                if (! tile_layer_index->cell)
+                {
+                    plog_error("%s: error allocating memory.", __func__);
+                    return ESZ_ERROR_CRITICAL;
+                }
+            }
 
-                        if (get_boolean_property(H_solid_above, tile->properties, prop_cnt, core))
-                        {
-                            SET_STATE(core->map->tile_properties[tile_index], TILE_SOLID_ABOVE);
-                        }
+            /* The counts are turned into start offsets shifted by one
+             * chunk; filling the cells advances each one to the start
+             * of the following chunk, which leaves the end offsets
+             * in place.
+             */
+            for (int32_t index = 0; index < chunk_count; index += 1)
+            {
+                int32_t count = tile_layer_index->chunk_offset[index + 1];
 
-                        if (get_boolean_property(H_solid_below, tile->properties, prop_cnt, core))
-                        {
-                            SET_STATE(core->map->tile_properties[tile_index], TILE_SOLID_BELOW);
-                        }
+                tile_layer_index->chunk_offset[index + 1] = offset;
+                offset                                   += count;
+            }
 
-                        if (get_boolean_property(H_solid_left, tile->properties, prop_cnt, core))
-                        {
-                            SET_STATE(core->map->tile_properties[tile_index], TILE_SOLID_LEFT);
-                        }
+            for (int32_t index_height = 0; index_height < (int32_t)core->map->handle->height; index_height += 1)
+            {
+                for (int32_t index_width = 0; index_width < (int32_t)core->map->handle->width; index_width += 1)
+                {
+                    int32_t tile_index = (index_height * (int32_t)core->map->handle->width) + index_width;
+                    int32_t gid        = remove_gid_flip_bits((int32_t)layer_content[tile_index]);
 
-                        if (get_boolean_property(H_solid_right, tile->properties, prop_cnt, core))
-                        {
-                            SET_STATE(core->map->tile_properties[tile_index], TILE_SOLID_RIGHT);
-                        }
+                    if (is_gid_valid(gid, core->map->handle))
+                    {
+                        int32_t* chunk_end = &tile_layer_index->chunk_offset[get_tile_chunk_index(index_width, index_height, core) + 1];
+
+                        tile_layer_index->cell[*chunk_end] = tile_index;
+                        *chunk_end                       += 1;
                     }
                 }
             }
+
+            cell_count += tile_layer_index->cell_count;
         }
-        layer = layer->next;
+
+        layer_index += 1;
+        layer        = layer->next;
     }
 
+    plog_info("Index %d occupied tile(s) in %d layer(s).", cell_count, core->map->layer_count);
     return ESZ_OK;
 }
 
-esz_status load_tileset(esz_window_t* window, esz_core_t* core)
+esz_status load_tile_properties(esz_core_t* core)
 {
-    esz_status status      = ESZ_OK;
-    char*      image_path  = NULL;
-    int32_t    path_length = get_tileset_path_length(core);
+    esz_tiled_layer_t* layer       = get_head_layer(core->map->handle);
+    int32_t            tile_count  = (int32_t)(core->map->handle->height * core->map->handle->width);
+    int32_t            layer_index = 0;
 
-    image_path = calloc(1, path_length);
-    if (! image_path)
+    core->map->tile_properties = (uint32_t*)calloc((size_t)tile_count, sizeof(uint32_t));
+    if (! core->map->tile_properties)
     {
         plog_error("%s: error allocating memory.", __func__);
+        return ESZ_WARNING;
+    }
+
+    if (! core->map->tile_layer_index)
+    {
+        return ESZ_OK;
+    }
+
+    // Only occupied cells can contribute any properties.
+    while (layer)
+    {
+        esz_tile_layer_index_t* tile_layer_index = &core->map->tile_layer_index[layer_index];
+        int32_t*                layer_content    = get_layer_content(layer);
+
+        for (int32_t index = 0; index < tile_layer_index->cell_count; index += 1)
+        {
+            int32_t tile_index = tile_layer_index->cell[index];
+
+            set_tile_properties(remove_gid_flip_bits((int32_t)layer_content[tile_index]), tile_index, core);
+        }
+
+        layer_index += 1;
+        layer        = layer->next;
+    }
+
+    return ESZ_OK;
+}
+
+esz_status load_tileset(esz_core_t* core)
+{
+    int32_t tile_width  = get_tile_width(core->map->handle);
+    int32_t tile_height = get_tile_height(core->map->handle);
+
+    core->map->tileset_count     = get_tileset_count(core->map->handle);
+    core->map->tile_source_count = get_tile_count(core->map->handle);
+
+    if (0 >= core->map->tileset_count || 0 >= core->map->tile_source_count)
+    {
+        plog_error("%s: no tileset found.", __func__);
         return ESZ_ERROR_CRITICAL;
     }
 
-    set_tileset_path(image_path, path_length, core);
+    core->map->tileset = (esz_tileset_t*)calloc((size_t)core->map->tileset_count, sizeof(struct esz_tileset));
+    if (! core->map->tileset)
+    {
+        plog_error("%s: error allocating memory.", __func__);
+        return ESZ_ERROR_CRITICAL;
+    }
 
-    if (ESZ_OK != load_texture_from_file(image_path, &core->map->tileset_texture, window))
+    core->map->tile_source = (esz_tile_source_t*)calloc((size_t)core->map->tile_source_count, sizeof(struct esz_tile_source));
+    if (! core->map->tile_source)
     {
-        plog_error("%s: Error loading image '%s'.", __func__, image_path);
-        status = ESZ_ERROR_CRITICAL;
+        plog_error("%s: error allocating memory.", __func__);
+        return ESZ_ERROR_CRITICAL;
     }
 
-    free(image_path);
-    return status;
+    /* Remark: the position of each tile is resolved once here, so that
+     * drawing a tile only takes a single lookup by gid.  The atlas
+     * offsets are added as soon as the atlas has been built.
+     */
+    for (int32_t gid = 0; gid < core->map->tile_source_count; gid += 1)
+    {
+        esz_tile_source_t* tile_source = &core->map->tile_source[gid];
+
+        tile_source->tileset_index = get_tileset_index(gid, core->map->handle);
+        tile_source->opacity       = TILE_EMPTY;
+
+        if (0 > tile_source->tileset_index)
+        {
+            continue;
+        }
+
+        get_tile_position(gid, &tile_source->src.x, &tile_source->src.y, core->map->handle);
+
+        tile_source->src.w = tile_width;
+        tile_source->src.h = tile_height;
+
+        if (0 == core->map->tileset[tile_source->tileset_index].first_gid)
+        {
+            core->map->tileset[tile_source->tileset_index].first_gid = gid;
+        }
+    }
+
+    for (int32_t index = 0; index < core->map->tileset_count; index += 1)
+    {
+        esz_status     status      = ESZ_OK;
+        esz_tileset_t* tileset     = &core->map->tileset[index];
+        char*          image_path  = NULL;
+        SDL_Surface*   surface     = NULL;
+        int32_t        path_length = get_tileset_path_length(index, core);
+
+        if (0 >= path_length)
+        {
+            return ESZ_ERROR_CRITICAL;
+        }
+
+        image_path = calloc(1, (size_t)path_length);
+        if (! image_path)
+        {
+            plog_error("%s: error allocating memory.", __func__);
+            return ESZ_ERROR_CRITICAL;
+        }
+
+        set_tileset_path(image_path, path_length, index, core);
+
+        if (ESZ_OK != load_surface_from_file(image_path, &surface))
+        {
+            plog_error("%s: Error loading image '%s'.", __func__, image_path);
+            status = ESZ_ERROR_CRITICAL;
+        }
+        else if (ESZ_OK != load_tile_opacity(surface, index, core))
+        {
+            SDL_FreeSurface(surface);
+            status = ESZ_ERROR_CRITICAL;
+        }
+        else if (ESZ_OK != add_atlas_image(surface, &tileset->texture, &tileset->offset_x, &tileset->offset_y, &core->map->atlas))
+        {
+            status = ESZ_ERROR_CRITICAL;
+        }
+
+        free(image_path);
+
+        if (ESZ_OK != status)
+        {
+            return status;
+        }
+    }
+
+    plog_info("Load %d tileset(s) covering %d gid(s).", core->map->tileset_count, core->map->tile_source_count - 1);
+    return ESZ_OK;
+}
+
+esz_status load_texture_atlas(esz_window_t* window, esz_core_t* core)
+{
+    if (ESZ_OK != build_atlas(&core->map->atlas, window))
+    {
+        return ESZ_ERROR_CRITICAL;
+    }
+
+    // Point the tile sources into the atlas.
+    for (int32_t gid = 0; gid < core->map->tile_source_count; gid += 1)
+    {
+        esz_tile_source_t* tile_source = &core->map->tile_source[gid];
+        esz_tileset_t*     tileset;
+
+        if (0 > tile_source->tileset_index)
+        {
+            continue;
+        }
+
+        tileset = &core->map->tileset[tile_source->tileset_index];
+
+        tile_source->texture  = tileset->texture;
+        tile_source->src.x   += tileset->offset_x;
+        tile_source->src.y   += tileset->offset_y;
+    }
+
+    return ESZ_OK;
 }
 
 /* Based on
@@ -554,6 +1076,7 @@ esz_status load_tileset(esz_window_t* window, esz_core_t* core)
  */
 esz_status load_texture_from_file(const char* file_name, SDL_Texture** texture, esz_window_t* window)
 {
+    esz_status     status;
     SDL_Surface*   surface;
     int            width;
     int            height;
@@ -600,17 +1123,23 @@ esz_status load_texture_from_file(const char* file_name, SDL_Texture** texture,
         return ESZ_ERROR_CRITICAL;
     }
 
-    *texture = SDL_CreateTextureFromSurface(window->renderer, surface);
+    status = create_texture_from_surface(texture, surface, window);
 
     SDL_FreeSurface(surface);
     stbi_image_free(data);
 
+    if (ESZ_OK != status)
+    {
+        return status;
+    }
+
     plog_info("Loading image from file: %s.", file_name);
     return ESZ_OK;
 }
 
 esz_status load_texture_from_memory(const unsigned char* buffer, const int length, SDL_Texture** texture, esz_window_t* window)
 {
+    esz_status     status;
     SDL_Surface*   surface;
     int            width;
     int            height;
@@ -657,27 +1186,164 @@ esz_status load_texture_from_memory(const unsigned char* buffer, const int lengt
         return ESZ_ERROR_CRITICAL;
     }
 
-    *texture = SDL_CreateTextureFromSurface(window->renderer, surface);
+    status = create_texture_from_surface(texture, surface, window);
 
     SDL_FreeSurface(surface);
     stbi_image_free(data);
 
+    if (ESZ_OK != status)
+    {
+        return status;
+    }
+
     plog_info("Loading image from memory.");
     return ESZ_OK;
 }
 
+static esz_draw_layer_t* add_draw_layer(esz_draw_layer_type type, esz_render_layer render_layer, esz_core_t* core)
+{
+    esz_draw_layer_t* draw_layer = &core->map->draw_layer[core->map->draw_layer_count];
+
+    draw_layer->type         = type;
+    draw_layer->render_layer = render_layer;
+    draw_layer->layer_index  = -1;
+    draw_layer->level        = -1;
+
+    if (ESZ_DRAW_MAP_LEVEL == type)
+    {
+        draw_layer->level                                 = core->map->level_count;
+        core->map->level_render_layer[draw_layer->level]  = render_layer;
+        core->map->level_count                           += 1;
+    }
+
+    core->map->draw_layer_count += 1;
+
+    return draw_layer;
+}
+
+static void add_fixed_draw_layers(esz_core_t* core)
+{
+    /* Remark: tile layers are drawn to ESZ_MAP_FG if is_in_foreground
+     * is set and to ESZ_MAP_BG otherwise; the tile layers of each of
+     * them form one map level and keep their Tiled layer order.
+     * Actors are drawn to the actor render layers selected by their
+     * state.
+     */
+    for (int32_t render_layer = ESZ_ACTOR_BG; render_layer < ESZ_RENDER_LAYER_MAX; render_layer += 1)
+    {
+        esz_tiled_layer_t* layer       = get_head_layer(core->map->handle);
+        esz_draw_layer_t*  draw_layer  = NULL;
+        int32_t            layer_index = 0;
+
+        if (ESZ_MAP_BG != render_layer && ESZ_MAP_FG != render_layer)
+        {
+            if (0 < core->map->entity_count)
+            {
+                add_draw_layer(ESZ_DRAW_ACTORS, (esz_render_layer)render_layer, core);
+            }
+            continue;
+        }
+
+        while (layer)
+        {
+            if (is_tiled_layer_of_type(ESZ_TILE_LAYER, layer, core) && layer->visible)
+            {
+                bool is_in_foreground = get_boolean_property(H_is_in_foreground, layer->properties, get_layer_property_count(layer), core);
+
+                if (is_in_foreground == (ESZ_MAP_FG == render_layer))
+                {
+                    if (! draw_layer)
+                    {
+                        draw_layer = add_draw_layer(ESZ_DRAW_MAP_LEVEL, (esz_render_layer)render_layer, core);
+                    }
+
+                    core->map->tile_layer_level[layer_index] = draw_layer->level;
+                }
+            }
+
+            layer_index += 1;
+            layer        = layer->next;
+        }
+    }
+}
+
+static void add_tiled_draw_layers(esz_core_t* core)
+{
+    esz_tiled_layer_t* layer        = get_head_layer(core->map->handle);
+    esz_render_layer   render_layer = ESZ_ACTOR_BG;
+    int32_t            entity_index = 0;
+    int32_t            layer_index  = 0;
+
+    // Actors in the background are drawn behind all layers.
+    if (0 < core->map->entity_count)
+    {
+        add_draw_layer(ESZ_DRAW_ACTORS, ESZ_ACTOR_BG, core);
+    }
+
+    /* Remark: each visible tile layer and each object group with
+     * actors is drawn in Tiled layer order.  The entries are spread
+     * over the render layers in the order they are composed, each
+     * moving on to the next render layer of its kind.  Once there are
+     * none left, the remaining entries share ESZ_ACTOR_FG and the
+     * render queue keeps them in order.
+     */
+    while (layer)
+    {
+        esz_draw_layer_type type        = ESZ_DRAW_MAP_LEVEL;
+        esz_draw_layer_t*   draw_layer;
+        int32_t             actor_count = 0;
+
+        if (is_tiled_layer_of_type(ESZ_OBJECT_GROUP, layer, core))
+        {
+            esz_tiled_object_t* tiled_object = get_head_object(layer, core);
+
+            type = ESZ_DRAW_ACTORS;
+
+            while (tiled_object)
+            {
+                if (core->map->entity[entity_index].actor)
+                {
+                    actor_count += 1;
+                }
+                entity_index += 1;
+                tiled_object  = tiled_object->next;
+            }
+        }
+
+        if ((ESZ_DRAW_ACTORS == type && 0 < actor_count) ||
+            (ESZ_DRAW_MAP_LEVEL == type && is_tiled_layer_of_type(ESZ_TILE_LAYER, layer, core) && layer->visible))
+        {
+            while (ESZ_ACTOR_FG > render_layer && (ESZ_DRAW_MAP_LEVEL == type) != (ESZ_MAP_BG == render_layer || ESZ_MAP_FG == render_layer))
+            {
+                render_layer = (esz_render_layer)(render_layer + 1);
+            }
+
+            draw_layer = add_draw_layer(type, render_layer, core);
+
+            if (ESZ_DRAW_ACTORS == type)
+            {
+                draw_layer->layer_index  = layer_index;
+                draw_layer->entity_count = actor_count;
+            }
+            else
+            {
+                core->map->tile_layer_level[layer_index] = draw_layer->level;
+            }
+        }
+
+        layer_index += 1;
+        layer        = layer->next;
+    }
+}
+
 static esz_status load_background_layer(int32_t index, esz_window_t* window, esz_core_t* core)
 {
-    esz_status   status        = ESZ_OK;
-    SDL_Texture* image_texture = NULL;
-    SDL_Rect     dst;
-    int32_t      image_width;
-    int32_t      image_height;
-    int32_t      prop_cnt          = get_map_property_count(core->map->handle);
-    int32_t      source_length     = 0;
-    double       layer_width_factor;
-    char         property_name[21] = { 0 };
-    char*        background_layer_image_source;
+    esz_status              status            = ESZ_OK;
+    esz_background_layer_t* layer             = &core->map->background.layer[index];
+    int32_t                 prop_cnt          = get_map_property_count(core->map->handle);
+    int32_t                 source_length     = 0;
+    char                    property_name[21] = { 0 };
+    char*                   background_layer_image_source;
 
     stbsp_snprintf(property_name, 21, "background_layer_%u", index + 1);
 
@@ -693,78 +1359,161 @@ static esz_status load_background_layer(int32_t index, esz_window_t* window, esz
 
     stbsp_snprintf(background_layer_image_source, source_length, "%s%s", core->map->path, file_name);
 
-    if (ESZ_ERROR_CRITICAL == load_texture_from_file(background_layer_image_source, &image_texture, window))
+    /* The image is repeated horizontally when rendering, so there is no
+     * need to keep a pre-tiled copy that grows with the window width.
+     */
+    if (ESZ_ERROR_CRITICAL == load_texture_from_file(background_layer_image_source, &layer->texture, window))
     {
         status = ESZ_ERROR_CRITICAL;
         goto exit;
     }
 
-    free(background_layer_image_source);
+    if (0 > SDL_QueryTexture(layer->texture, NULL, NULL, &layer->width, &layer->height))
+    {
+        plog_error("%s: %s.", __func__, SDL_GetError());
+        status = ESZ_ERROR_CRITICAL;
+        goto exit;
+    }
 
-    if (0 > SDL_QueryTexture(image_texture, NULL, NULL, &image_width, &image_height))
+    if (0 > SDL_SetTextureBlendMode(layer->texture, SDL_BLENDMODE_BLEND))
     {
         plog_error("%s: %s.", __func__, SDL_GetError());
         status = ESZ_ERROR_CRITICAL;
         goto exit;
     }
 
-    layer_width_factor = ceil((double)window->width / (double)image_width);
+    plog_info("Load background layer %d.", index + 1);
 
-    core->map->background.layer[index].width  = image_width * (int32_t)layer_width_factor;
-    core->map->background.layer[index].height = image_height;
+exit:
+    free(background_layer_image_source);
+    return status;
+}
 
-    core->map->background.layer[index].texture = SDL_CreateTexture(
-        window->renderer,
-        SDL_PIXELFORMAT_ARGB8888,
-        SDL_TEXTUREACCESS_TARGET,
-        core->map->background.layer[index].width,
-        core->map->background.layer[index].height);
+static esz_status load_tile_animation(int32_t gid, int32_t frame_count, int32_t* animation, esz_core_t* core)
+{
+    esz_tile_animation_t* tile_animation;
+    int32_t               first_gid = core->map->tileset[core->map->tile_source[gid].tileset_index].first_gid;
 
-    if (! core->map->background.layer[index].texture)
+    for (int32_t index = 0; index < core->map->tile_animation_count; index += 1)
     {
-        plog_error("%s: %s.", __func__, SDL_GetError());
-        status = ESZ_ERROR_CRITICAL;
-        goto exit;
+        if (gid == core->map->tile_animation[index].id)
+        {
+            *animation = index;
+            return ESZ_OK;
+        }
     }
 
-    if (0 != SDL_SetRenderTarget(window->renderer, core->map->background.layer[index].texture))
+    tile_animation = (esz_tile_animation_t*)realloc(core->map->tile_animation, (size_t)(core->map->tile_animation_count + 1) * sizeof(struct esz_tile_animation));
+    if (! tile_animation)
     {
-        plog_error("%s: %s.", __func__, SDL_GetError());
-        status = ESZ_ERROR_CRITICAL;
-        goto exit;
+        plog_error("%s: error allocating memory.", __func__);
+        return ESZ_ERROR_CRITICAL;
+    }
+
+    core->map->tile_animation = tile_animation;
+    tile_animation            = &core->map->tile_animation[core->map->tile_animation_count];
+
+    tile_animation->current_frame = 0;
+    tile_animation->frame_count   = frame_count;
+    tile_animation->id            = gid;
+    tile_animation->frame         = (int32_t*)calloc((size_t)frame_count, sizeof(int32_t));
+    if (! tile_animation->frame)
+    {
+        plog_error("%s: error allocating memory.", __func__);
+        return ESZ_ERROR_CRITICAL;
     }
 
-    dst.x = 0;
-    int32_t pass;
-    for (pass = 0; pass < layer_width_factor; pass += 1)
+    // Frames refer to tiles of the same tileset by their local ID.
+    for (int32_t index = 0; index < frame_count; index += 1)
     {
-        dst.y = 0;
-        dst.w = image_width;
-        dst.h = image_height;
+        int32_t frame_gid = first_gid + get_next_animated_tile_id(gid, index, core->map->handle);
 
-        if (0 > SDL_RenderCopy(window->renderer, image_texture, NULL, &dst))
+        if (0 >= frame_gid || frame_gid >= core->map->tile_source_count)
         {
-            plog_error("%s: %s.", __func__, SDL_GetError());
-            status = ESZ_ERROR_CRITICAL;
-            goto exit;
+            frame_gid = 0;
         }
 
-        dst.x += image_width;
+        tile_animation->frame[index] = frame_gid;
     }
 
-    if (0 > SDL_SetTextureBlendMode(core->map->background.layer[index].texture, SDL_BLENDMODE_BLEND))
+    *animation                       = core->map->tile_animation_count;
+    core->map->tile_animation_count += 1;
+
+    return ESZ_OK;
+}
+
+static esz_status load_tile_opacity(SDL_Surface* surface, int32_t tileset_index, esz_core_t* core)
+{
+    int32_t tile_count   = 0;
+    int32_t empty_count  = 0;
+    int32_t opaque_count = 0;
+
+    if (0 > SDL_LockSurface(surface))
     {
         plog_error("%s: %s.", __func__, SDL_GetError());
-        status = ESZ_ERROR_CRITICAL;
-        goto exit;
+        return ESZ_ERROR_CRITICAL;
     }
 
-exit:
-    if (image_texture)
+    // The surface is RGBA32, so the alpha channel is every fourth byte.
+    for (int32_t gid = 0; gid < core->map->tile_source_count; gid += 1)
     {
-        SDL_DestroyTexture(image_texture);
+        esz_tile_source_t* tile_source      = &core->map->tile_source[gid];
+        bool               has_transparency = false;
+        bool               has_coverage     = false;
+
+        if (tileset_index != tile_source->tileset_index)
+        {
+            continue;
+        }
+
+        tile_count += 1;
+
+        // Tiles reaching past the image are treated as empty.
+        if (tile_source->src.x + tile_source->src.w > surface->w || tile_source->src.y + tile_source->src.h > surface->h)
+        {
+            tile_source->opacity = TILE_EMPTY;
+            empty_count += 1;
+            continue;
+        }
+
+        for (int32_t pixel_y = tile_source->src.y; pixel_y < tile_source->src.y + tile_source->src.h; pixel_y += 1)
+        {
+            const uint8_t* pixel = (const uint8_t*)surface->pixels + (pixel_y * surface->pitch) + (tile_source->src.x * 4);
+
+            for (int32_t pixel_x = 0; pixel_x < tile_source->src.w; pixel_x += 1)
+            {
+                uint8_t alpha = pixel[(pixel_x * 4) + 3];
+
+                if (SDL_ALPHA_OPAQUE != alpha)
+                {
+                    has_transparency = true;
+                }
+
+                if (SDL_ALPHA_TRANSPARENT != alpha)
+                {
+                    has_coverage = true;
+                }
+            }
+        }
+
+        if (! has_coverage)
+        {
+            tile_source->opacity = TILE_EMPTY;
+            empty_count += 1;
+        }
+        else if (! has_transparency)
+        {
+            tile_source->opacity = TILE_OPAQUE;
+            opaque_count += 1;
+        }
+        else
+        {
+            tile_source->opacity = TILE_TRANSLUCENT;
+        }
     }
 
-    plog_info("Load background layer %d.", index + 1);
-    return status;
+    SDL_UnlockSurface(surface);
+
+    plog_info("Classify %d tile(s) of tileset %d: %d empty, %d opaque.", tile_count, tileset_index + 1, empty_count, opaque_count);
+    return ESZ_OK;
 }
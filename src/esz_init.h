@@ -14,11 +14,16 @@
 
 esz_status load_animated_tiles(esz_core_t* core);
 esz_status load_background(esz_window_t* window, esz_core_t* core);
+esz_status load_draw_order(esz_core_t* core);
 esz_status load_entities(esz_core_t* core);
+esz_status load_map_chunks(esz_core_t* core);
 esz_status load_map_path(const char* map_file_name, esz_core_t* core);
-esz_status load_sprites(esz_window_t* window, esz_core_t* core);
+esz_status load_sprites(esz_core_t* core);
+esz_status load_surface_from_file(const char* file_name, SDL_Surface** surface);
+esz_status load_tile_layer_index(esz_core_t* core);
 esz_status load_tile_properties(esz_core_t* core);
-esz_status load_tileset(esz_window_t* window, esz_core_t*);
+esz_status load_tileset(esz_core_t* core);
+esz_status load_texture_atlas(esz_window_t* window, esz_core_t* core);
 esz_status load_texture_from_file(const char* file_name, SDL_Texture** texture, esz_window_t* window);
 esz_status load_texture_from_memory(const unsigned char* buffer, const int length, SDL_Texture** texture, esz_window_t* window);
 
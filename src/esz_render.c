@@ -4,41 +4,159 @@
  * @brief   eszFW rendering and scene drawing
  */
 
+#include <math.h>
 #include <picolog.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
 
+#include "esz.h"
+#include "esz_batch.h"
 #include "esz_compat.h"
 #include "esz_hash.h"
 #include "esz_macros.h"
+#include "esz_simulation.h"
+#include "esz_texture.h"
 #include "esz_types.h"
 #include "esz_utils.h"
 
+static esz_status bake_map_chunk(int32_t level, esz_map_chunk_t* chunk, esz_window_t* window, esz_core_t* core);
+static esz_status bake_map_chunk_mip(int32_t level, int32_t mip_level, esz_map_chunk_t* chunk, esz_window_t* window, esz_core_t* core);
+static esz_status create_map_chunk_texture(SDL_Texture** texture, int32_t mip_level, esz_map_chunk_t* chunk, esz_window_t* window, esz_core_t* core);
+static void       destroy_map_chunk_mips(int32_t level, esz_map_chunk_t* chunk, esz_window_t* window, esz_core_t* core);
+static void       destroy_map_chunk_texture(SDL_Texture** texture, esz_window_t* window, esz_core_t* core);
+static bool       evict_map_chunk(esz_window_t* window, esz_core_t* core);
+static void       evict_map_chunks(esz_window_t* window, esz_core_t* core);
+static void       get_visible_chunks(int32_t* first_index_width, int32_t* first_index_height, int32_t* last_index_width, int32_t* last_index_height, esz_window_t* window, esz_core_t* core);
+static bool       is_render_layer_clean(esz_render_layer render_layer, esz_window_t* window, esz_core_t* core);
+static bool       is_render_layer_skipped(esz_render_layer render_layer, esz_window_t* window, esz_core_t* core);
+static bool       is_render_target_size_valid(int32_t width, int32_t height, esz_core_t* core);
+static esz_status render_animated_tiles_of_chunk(int32_t level, esz_map_chunk_t* chunk, esz_window_t* window, esz_core_t* core);
 static esz_status render_background_layer(int32_t index, esz_window_t* window, esz_core_t* core);
+static esz_status set_render_layer_target(esz_render_layer render_layer, esz_window_t* window, esz_core_t* core);
+static void       set_tileset_blend_mode(SDL_BlendMode blend_mode, esz_core_t* core);
+static esz_status submit_queue(esz_window_t* window, esz_core_t* core);
 
-esz_status create_and_set_render_target(SDL_Texture** target, esz_window_t* window)
+esz_status bake_nearby_map_chunks(double time_limit, int32_t margin, esz_window_t* window, esz_core_t* core)
 {
-    if (! (*target))
+    esz_snapshot_t* snapshot    = get_render_snapshot(core);
+    double          frequency   = (double)SDL_GetPerformanceFrequency();
+    double          center_x    = snapshot->camera_pos_x - core->map->pos_x + ((double)window->logical_width  / 2.0);
+    double          center_y    = snapshot->camera_pos_y - core->map->pos_y + ((double)window->logical_height / 2.0);
+    uint64_t        start_time  = SDL_GetPerformanceCounter();
+    int32_t         baked_count = 0;
+    int32_t         first_index_width;
+    int32_t         first_index_height;
+    int32_t         last_index_width;
+    int32_t         last_index_height;
+
+    get_visible_chunks(&first_index_width, &first_index_height, &last_index_width, &last_index_height, window, core);
+
+    first_index_width  = SDL_max(first_index_width  - margin, 0);
+    first_index_height = SDL_max(first_index_height - margin, 0);
+    last_index_width   = SDL_min(last_index_width   + margin, core->map->chunk_count_x - 1);
+    last_index_height  = SDL_min(last_index_height  + margin, core->map->chunk_count_y - 1);
+
+    // A time limit of zero bakes all chunks in range at once.
+    while (0.0 >= time_limit || (double)(SDL_GetPerformanceCounter() - start_time) / frequency < time_limit)
     {
-        (*target) = SDL_CreateTexture(
-            window->renderer,
-            SDL_PIXELFORMAT_ARGB8888,
-            SDL_TEXTUREACCESS_TARGET,
-            window->width,
-            window->height);
+        esz_map_chunk_t* nearest_chunk    = NULL;
+        double           nearest_distance = 0.0;
+
+        for (int32_t index_height = first_index_height; index_height <= last_index_height; index_height += 1)
+        {
+            for (int32_t index_width = first_index_width; index_width <= last_index_width; index_width += 1)
+            {
+                esz_map_chunk_t* chunk       = &core->map->chunk[(index_height * core->map->chunk_count_x) + index_width];
+                bool             is_complete = true;
+                double           distance_x;
+                double           distance_y;
+                double           distance;
+
+                for (int32_t level = 0; level < core->map->level_count; level += 1)
+                {
+                    if (! chunk->layer_texture[level])
+                    {
+                        is_complete = false;
+                    }
+                }
+
+                if (is_complete)
+                {
+                    continue;
+                }
+
+                distance_x = (double)chunk->pos_x + ((double)chunk->width  / 2.0) - center_x;
+                distance_y = (double)chunk->pos_y + ((double)chunk->height / 2.0) - center_y;
+                distance   = (distance_x * distance_x) + (distance_y * distance_y);
+
+                if (! nearest_chunk || distance < nearest_distance)
+                {
+                    nearest_chunk    = chunk;
+                    nearest_distance = distance;
+                }
+            }
+        }
+
+        if (! nearest_chunk)
+        {
+            break;
+        }
+
+        // The chunk is in use from now on and can't be evicted while it is baked.
+        nearest_chunk->last_render_frame = core->map->render_frame;
+
+        for (int32_t level = 0; level < core->map->level_count; level += 1)
+        {
+            size_t size = (size_t)nearest_chunk->width * (size_t)nearest_chunk->height * 4;
+
+            if (nearest_chunk->layer_texture[level])
+            {
+                continue;
+            }
+
+            // Chunks baked ahead of time must not push others out.
+            if (core->map->chunk_memory_usage + size > core->chunk_memory_budget || is_texture_budget_exceeded(size, window))
+            {
+                goto exit;
+            }
+
+            if (ESZ_OK != bake_map_chunk(level, nearest_chunk, window, core))
+            {
+                return ESZ_ERROR_CRITICAL;
+            }
+        }
+
+        baked_count += 1;
     }
 
-    if (! (*target))
+exit:
+    if (0.0 >= time_limit && 0 < baked_count)
     {
-        plog_error("%s: %s.", __func__, SDL_GetError());
-        return ESZ_ERROR_CRITICAL;
+        plog_info("Bake %d map chunk(s) ahead of time.", baked_count);
     }
-    else
+
+    return ESZ_OK;
+}
+
+esz_status create_and_set_render_target(SDL_Texture** target, esz_window_t* window, esz_core_t* core)
+{
+    if (! (*target))
     {
+        if (ESZ_OK != acquire_render_target(
+                target,
+                SDL_PIXELFORMAT_ARGB8888,
+                core->map->render_target_width,
+                core->map->render_target_height,
+                window))
+        {
+            return ESZ_ERROR_CRITICAL;
+        }
+
         if (0 > SDL_SetTextureBlendMode((*target), SDL_BLENDMODE_BLEND))
         {
             plog_error("%s: %s.", __func__, SDL_GetError());
-            SDL_DestroyTexture((*target));
+            release_render_target(target, window);
             return ESZ_ERROR_CRITICAL;
         }
     }
@@ -46,7 +164,7 @@ esz_status create_and_set_render_target(SDL_Texture** target, esz_window_t* wind
     if (0 > SDL_SetRenderTarget(window->renderer, (*target)))
     {
         plog_error("%s: %s.", __func__, SDL_GetError());
-        SDL_DestroyTexture((*target));
+        release_render_target(target, window);
         return ESZ_ERROR_CRITICAL;
     }
 
@@ -55,9 +173,25 @@ esz_status create_and_set_render_target(SDL_Texture** target, esz_window_t* wind
     return ESZ_OK;
 }
 
+void destroy_map_chunks(esz_window_t* window, esz_core_t* core)
+{
+    for (int32_t index = 0; index < (core->map->chunk_count_x * core->map->chunk_count_y); index += 1)
+    {
+        esz_map_chunk_t* chunk = &core->map->chunk[index];
+
+        for (int32_t level = 0; level < core->map->level_count; level += 1)
+        {
+            destroy_map_chunk_mips(level, chunk, window, core);
+            destroy_map_chunk_texture(&chunk->layer_texture[level], window, core);
+            destroy_map_chunk_texture(&chunk->animated_tile_overlay[level].texture, window, core);
+        }
+    }
+}
+
 esz_status draw_scene(esz_window_t* window, esz_core_t* core)
 {
     SDL_Rect dst;
+    SDL_Rect src;
 
     if (0 > SDL_SetRenderTarget(window->renderer, NULL))
     {
@@ -86,19 +220,27 @@ esz_status draw_scene(esz_window_t* window, esz_core_t* core)
         return ESZ_OK;
     }
 
+    /* The scene covers the top-left part of the render targets and is
+     * scaled up to the window size right here.
+     */
+    get_render_target_size(&src.w, &src.h, window);
+
+    src.x = 0;
+    src.y = 0;
     dst.x = 0;
     dst.y = 0;
-    dst.w = window->width;
-    dst.h = window->height;
+    dst.w = window->logical_width;
+    dst.h = window->logical_height;
 
-    for (int32_t index = 0; index < ESZ_RENDER_LAYER_MAX; index += 1)
+    // The layers have already been drawn to the window.
+    for (int32_t index = 0; index < ESZ_RENDER_LAYER_MAX && ! window->direct_composition_enabled; index += 1)
     {
         if (IS_STATE_SET(core->debug, index))
         {
             continue;
         }
 
-        if (0 > SDL_RenderCopy(window->renderer, core->map->render_target[index], NULL, &dst))
+        if (0 > SDL_RenderCopy(window->renderer, core->map->render_target[index], &src, &dst))
         {
             plog_error("%s: %s.", __func__, SDL_GetError());
             return ESZ_ERROR_CRITICAL;
@@ -111,192 +253,266 @@ esz_status draw_scene(esz_window_t* window, esz_core_t* core)
     return ESZ_OK;
 }
 
-esz_status render_actors(int32_t level, esz_window_t* window, esz_core_t* core)
+bool is_scene_idle(esz_window_t* window, esz_core_t* core)
 {
-    esz_tiled_layer_t* layer;
-    esz_render_layer   render_layer = ESZ_ACTOR_FG;
-    int32_t            index        = 0;
+    esz_snapshot_t* snapshot;
+    int32_t         target_width;
+    int32_t         target_height;
+
+    // Nothing that is drawn now would be seen.
+    if (window->is_minimised)
+    {
+        return true;
+    }
+
+    if (window->is_redraw_required)
+    {
+        return false;
+    }
 
+    // Without a map, the logo has already been presented.
     if (! core->is_map_loaded)
     {
-        return ESZ_OK;
+        return true;
     }
 
-    layer = get_head_layer(core->map->handle);
+    acquire_snapshot(core);
+    snapshot = get_render_snapshot(core);
 
-    if (level >= ESZ_ACTOR_LAYER_LEVEL_MAX)
+    if (core->map->last_camera_pos_x != snapshot->camera_pos_x ||
+        core->map->last_camera_pos_y != snapshot->camera_pos_y ||
+        core->map->last_zoom_level   != window->zoom_level)
     {
-        plog_error("%s: invalid layer level selected.", __func__);
-        return ESZ_ERROR_CRITICAL;
+        return false;
     }
 
-    if (ESZ_ACTOR_LAYER_BG == level)
+    // The render targets are about to be recreated.
+    get_render_target_size(&target_width, &target_height, window);
+
+    if (! is_render_target_size_valid(target_width, target_height, core))
+    {
+        return false;
+    }
+
+    for (int32_t index = 0; index < ESZ_RENDER_LAYER_MAX && ! window->direct_composition_enabled; index += 1)
     {
-        render_layer = ESZ_ACTOR_BG;
+        if (! core->map->render_target[index])
+        {
+            return false;
+        }
     }
-    else if (ESZ_ACTOR_LAYER_MG == level)
+
+    return 0 == core->map->render_layer_dirty;
+}
+
+esz_status patch_map_chunk(int32_t level, int32_t index_width, int32_t index_height, esz_window_t* window, esz_core_t* core)
+{
+    esz_tiled_layer_t* layer        = get_head_layer(core->map->handle);
+    esz_render_layer   render_layer = core->map->level_render_layer[level];
+    int32_t            tile_width   = get_tile_width(core->map->handle);
+    int32_t            tile_height  = get_tile_height(core->map->handle);
+    int32_t            tile_index   = (index_height * (int32_t)core->map->handle->width) + index_width;
+    int32_t            base_layer   = -1;
+    int32_t            layer_index  = 0;
+    esz_map_chunk_t*   chunk        = get_map_chunk(index_width * tile_width, index_height * tile_height, core);
+    uint8_t            red;
+    uint8_t            green;
+    uint8_t            blue;
+    uint8_t            alpha;
+    SDL_BlendMode      blend_mode;
+    SDL_Rect           dst;
+
+    // Chunks that have not been baked yet pick up the change later.
+    if (! chunk->layer_texture[level])
     {
-        render_layer = ESZ_ACTOR_MG;
+        return ESZ_OK;
     }
 
-    if (ESZ_OK != create_and_set_render_target(&core->map->render_target[render_layer], window))
+    // The downsampled copies are scaled down again once they are needed.
+    destroy_map_chunk_mips(level, chunk, window, core);
+
+    if (0 > SDL_SetRenderTarget(window->renderer, chunk->layer_texture[level]))
     {
+        plog_error("%s: %s.", __func__, SDL_GetError());
         return ESZ_ERROR_CRITICAL;
     }
 
+    dst.w = tile_width;
+    dst.h = tile_height;
+    dst.x = (index_width  * tile_width)  - chunk->pos_x;
+    dst.y = (index_height * tile_height) - chunk->pos_y;
+
+    // Only the edited cell is cleared and redrawn.
+    SDL_GetRenderDrawColor(window->renderer, &red, &green, &blue, &alpha);
+    SDL_GetRenderDrawBlendMode(window->renderer, &blend_mode);
+    SDL_SetRenderDrawColor(window->renderer, 0x00, 0x00, 0x00, SDL_ALPHA_TRANSPARENT);
+    SDL_SetRenderDrawBlendMode(window->renderer, SDL_BLENDMODE_NONE);
+    SDL_RenderFillRect(window->renderer, &dst);
+    SDL_SetRenderDrawColor(window->renderer, red, green, blue, alpha);
+    SDL_SetRenderDrawBlendMode(window->renderer, blend_mode);
+
+    // Tiles below the top-most opaque tile are hidden anyway.
+    while (layer)
+    {
+        if (level == core->map->tile_layer_level[layer_index])
+        {
+            int32_t* layer_content = get_layer_content(layer);
+
+            if (TILE_OPAQUE == get_tile_opacity(remove_gid_flip_bits((int32_t)layer_content[tile_index]), core))
+            {
+                base_layer = layer_index;
+            }
+        }
+        layer_index += 1;
+        layer        = layer->next;
+    }
+
+    // The chunk may no longer be fully covered.
+    if (0 > base_layer)
+    {
+        SDL_SetTextureBlendMode(chunk->layer_texture[level], SDL_BLENDMODE_BLEND);
+    }
+
+    layer       = get_head_layer(core->map->handle);
+    layer_index = 0;
+
     while (layer)
     {
-        if (is_tiled_layer_of_type(ESZ_OBJECT_GROUP, layer, core))
+        if (level == core->map->tile_layer_level[layer_index])
         {
-            esz_tiled_object_t* tiled_object = get_head_object(layer, core);
-            while (tiled_object)
+            int32_t* layer_content = get_layer_content(layer);
+            int32_t  gid           = remove_gid_flip_bits((int32_t)layer_content[tile_index]);
+
+            if (layer_index >= base_layer && TILE_EMPTY != get_tile_opacity(gid, core))
             {
-                uint64_t      type_hash = generate_hash((const unsigned char*)get_object_type_name(tiled_object));
-                esz_entity_t* object    = &core->map->entity[index];
+                esz_tile_source_t* tile_source = &core->map->tile_source[gid];
 
-                switch (type_hash)
+                if (ESZ_OK != batch_quad(tile_source->texture, &tile_source->src, &dst, SDL_FLIP_NONE, window))
                 {
-                    case H_actor:
-                    {
-                        esz_actor_t**    actor = &object->actor;
-                        double           pos_x = object->pos_x - core->camera.pos_x;
-                        double           pos_y = object->pos_y - core->camera.pos_y;
-                        SDL_RendererFlip flip  = SDL_FLIP_NONE;
-                        SDL_Rect         dst   = { 0 };
-                        SDL_Rect         src   = { 0 };
-
-                        if (ESZ_ACTOR_LAYER_BG == level && ! IS_STATE_SET((*actor)->state, STATE_IN_BACKGROUND))
-                        {
-                            break;
-                        }
-
-                        if (ESZ_ACTOR_LAYER_MG == level && ! IS_STATE_SET((*actor)->state, STATE_IN_MIDGROUND))
-                        {
-                            break;
-                        }
-
-                        if (ESZ_ACTOR_LAYER_FG == level && ! IS_STATE_SET((*actor)->state, STATE_IN_FOREGROUND))
-                        {
-                                break;
-                        }
-
-                        if (IS_STATE_SET((*actor)->state, STATE_LOOKING_LEFT))
-                        {
-                            flip = SDL_FLIP_HORIZONTAL;
-                        }
-
-                        // Update animation frame
-                        // -----------------------------------------------------
-
-                        if (IS_STATE_SET((*actor)->state, STATE_ANIMATED) && (*actor)->animation)
-                        {
-                            int32_t current_animation = (*actor)->current_animation;
-
-                            (*actor)->time_since_last_anim_frame += window->time_since_last_frame;
-
-                            if ((*actor)->time_since_last_anim_frame >= 1.0 / (double)((*actor)->animation[current_animation - 1].fps))
-                            {
-                                (*actor)->time_since_last_anim_frame = 0.0;
-
-                                (*actor)->current_frame += 1;
-
-                                if ((*actor)->current_frame >= (*actor)->animation[current_animation - 1].length)
-                                {
-                                    (*actor)->current_frame = 0;
-                                }
-                            }
-
-                            src.x  = ((*actor)->animation[current_animation - 1].first_frame - 1) * object->width;
-                            src.x += (*actor)->current_frame                                      * object->width;
-                            src.y  = (*actor)->animation[current_animation - 1].offset_y          * object->height;
-                        }
-
-                        src.w  = object->width;
-                        src.h  = object->height;
-                        dst.x  = (int32_t)pos_x - (object->width  / 2);
-                        dst.y  = (int32_t)pos_y - (object->height / 2);
-                        dst.w  = object->width;
-                        dst.h  = object->height;
-
-                        if (0 > SDL_RenderCopyEx(window->renderer, core->map->sprite[(*actor)->sprite_sheet_id - 1].texture, &src, &dst, 0, NULL, flip))
-                        {
-                            plog_error("%s: %s.", __func__, SDL_GetError());
-                            return ESZ_ERROR_CRITICAL;
-                        }
-                        break;
-                    }
+                    return ESZ_ERROR_CRITICAL;
                 }
-                index        += 1;
-                tiled_object  = tiled_object->next;
             }
         }
-        layer = layer->next;
+        layer_index += 1;
+        layer        = layer->next;
+    }
+
+    if (ESZ_OK != flush_batch(window))
+    {
+        return ESZ_ERROR_CRITICAL;
     }
 
+    SET_STATE(core->map->render_layer_dirty, (uint32_t)render_layer);
+
     return ESZ_OK;
 }
 
-esz_status render_background(esz_window_t* window, esz_core_t* core)
+esz_status render_actors(esz_draw_layer_t* draw_layer, esz_window_t* window, esz_core_t* core)
 {
-    esz_status       status       = ESZ_OK;
-    esz_render_layer render_layer = ESZ_BACKGROUND;
-    double           factor;
+    esz_snapshot_t*  snapshot;
+    esz_render_layer render_layer = draw_layer->render_layer;
+    esz_aabb_t       viewport;
 
     if (! core->is_map_loaded)
     {
         return ESZ_OK;
     }
 
-    factor = (double)core->map->background.layer_count + 1.0;
+    snapshot = get_render_snapshot(core);
 
-    if (! core->map->render_target[render_layer])
+    viewport.bottom = snapshot->camera_pos_y + (double)window->logical_height;
+    viewport.left   = snapshot->camera_pos_x;
+    viewport.right  = snapshot->camera_pos_x + (double)window->logical_width;
+    viewport.top    = snapshot->camera_pos_y;
+
+    if (ESZ_DRAW_ACTORS != draw_layer->type)
     {
-        core->map->render_target[render_layer] = SDL_CreateTexture(
-            window->renderer,
-            SDL_PIXELFORMAT_ARGB8888,
-            SDL_TEXTUREACCESS_TARGET,
-            window->width,
-            window->height);
+        plog_error("%s: invalid draw layer selected.", __func__);
+        return ESZ_ERROR_CRITICAL;
     }
 
-    if (! core->map->render_target[render_layer])
+    if (is_render_layer_skipped(render_layer, window, core) || is_render_layer_clean(render_layer, window, core))
     {
-        plog_error("%s: %s.", __func__, SDL_GetError());
-        return ESZ_ERROR_CRITICAL;
+        return ESZ_OK;
     }
 
-    if (is_camera_at_horizontal_boundary(core))
+    queue_layer(render_layer, window);
+
+    // Only actors are listed in the draw order.
+    for (int32_t offset = 0; offset < draw_layer->entity_count; offset += 1)
     {
-        if (! core->map->background.velocity_is_constant)
+        int32_t                index  = core->map->draw_entity[draw_layer->entity_offset + offset];
+        esz_entity_t*          object = &core->map->entity[index];
+        esz_entity_snapshot_t* state  = &snapshot->entity[index];
+        esz_actor_t**          actor  = &object->actor;
+        double                 pos_x  = state->pos_x - snapshot->camera_pos_x;
+        double                 pos_y  = state->pos_y - snapshot->camera_pos_y;
+        SDL_RendererFlip       flip   = SDL_FLIP_NONE;
+        SDL_Rect               dst    = { 0 };
+        SDL_Rect               src    = { 0 };
+
+        if (IS_STATE_SET(state->state, STATE_LOOKING_LEFT))
         {
-            core->map->background.velocity = 0.0;
+            flip = SDL_FLIP_HORIZONTAL;
         }
-    }
-    else
-    {
-        if (core->map->entity)
+
+        // The animation frame is advanced by update_entities().
+        if (IS_STATE_SET(state->state, STATE_ANIMATED) && (*actor)->animation)
         {
-            if (core->map->entity[core->camera.target_actor_id].actor)
-            {
-                core->map->background.velocity = core->map->entity[core->camera.target_actor_id].actor->velocity_x;
-            }
+            int32_t current_animation = state->current_animation;
+
+            src.x  = ((*actor)->animation[current_animation - 1].first_frame - 1) * object->width;
+            src.x += state->current_frame                                         * object->width;
+            src.y  = (*actor)->animation[current_animation - 1].offset_y          * object->height;
         }
-        else
+
+        // Skip actors outside of the viewport.
+        if (! esz_bounding_boxes_do_intersect(state->bounding_box, viewport))
+        {
+            core->render_stats.actors_culled += 1;
+            continue;
+        }
+
+        src.x += core->map->sprite[(*actor)->sprite_sheet_id - 1].offset_x;
+        src.y += core->map->sprite[(*actor)->sprite_sheet_id - 1].offset_y;
+        src.w  = object->width;
+        src.h  = object->height;
+        dst.x  = (int32_t)pos_x - (object->width  / 2);
+        dst.y  = (int32_t)pos_y - (object->height / 2);
+        dst.w  = object->width;
+        dst.h  = object->height;
+
+        if (ESZ_OK != queue_quad(render_layer, core->map->sprite[(*actor)->sprite_sheet_id - 1].texture, &src, &dst, flip, window))
         {
-            core->map->background.velocity = 0.0;
+            return ESZ_ERROR_CRITICAL;
         }
+
+        core->render_stats.actors_drawn += 1;
     }
 
-    if (! core->camera.is_locked)
+    return ESZ_OK;
+}
+
+esz_status render_background(esz_window_t* window, esz_core_t* core)
+{
+    esz_status       status       = ESZ_OK;
+    esz_render_layer render_layer = ESZ_BACKGROUND;
+
+    if (! core->is_map_loaded)
     {
-        core->map->background.velocity = 0.0;
+        return ESZ_OK;
     }
 
-    for (int32_t index = 0; index < core->map->background.layer_count; index += 1)
+    if (is_render_layer_skipped(render_layer, window, core) || is_render_layer_clean(render_layer, window, core))
     {
-        core->map->background.layer[index].velocity = core->map->background.velocity / factor;
-        factor -= core->map->background.layer_shift;
+        return ESZ_OK;
+    }
+
+    queue_layer(render_layer, window);
 
+    // The scrolling is updated by update_background().
+    for (int32_t index = 0; index < core->map->background.layer_count; index += 1)
+    {
         status = render_background_layer(index, window, core);
 
         if (ESZ_OK != status)
@@ -310,385 +526,927 @@ esz_status render_background(esz_window_t* window, esz_core_t* core)
 
 esz_status render_map(int32_t level, esz_window_t* window, esz_core_t* core)
 {
-    esz_tiled_layer_t* layer;
-    bool               render_animated_tiles = false;
-    esz_render_layer   render_layer          = ESZ_MAP_FG;
+    bool             render_animated_tiles = false;
+    esz_render_layer render_layer;
+    int32_t          mip_level             = get_mip_level(window);
+    int32_t          first_index_width;
+    int32_t          first_index_height;
+    int32_t          last_index_width;
+    int32_t          last_index_height;
+    esz_snapshot_t*  snapshot;
 
     if (! core->is_map_loaded)
     {
         return ESZ_OK;
     }
 
-    layer = get_head_layer(core->map->handle);
+    snapshot = get_render_snapshot(core);
 
-    if (level >= ESZ_MAP_LAYER_LEVEL_MAX)
+    if (0 > level || level >= core->map->level_count)
     {
         plog_error("%s: invalid layer level selected.", __func__);
         return ESZ_ERROR_CRITICAL;
     }
 
-    if (ESZ_MAP_LAYER_BG == level)
-    {
-        render_layer = ESZ_MAP_BG;
-
-        if (0 < core->map->animated_tile_fps)
-        {
-            render_animated_tiles = true;
-        }
-    }
+    render_layer = core->map->level_render_layer[level];
 
-    if (ESZ_OK != create_and_set_render_target(&core->map->render_target[render_layer], window))
+    if (0 < core->map->animated_tile_fps)
     {
-        return ESZ_ERROR_CRITICAL;
+        render_animated_tiles = true;
     }
 
-    // Update and render animated tiles.
-    core->map->time_since_last_anim_frame += window->time_since_last_frame;
-
-    if (0 < core->map->animated_tile_index &&
-        core->map->time_since_last_anim_frame >= 1.0 / (double)(core->map->animated_tile_fps) && render_animated_tiles)
+    if (is_render_layer_skipped(render_layer, window, core) || is_render_layer_clean(render_layer, window, core))
     {
-        core->map->time_since_last_anim_frame = 0.0;
-
-        /* Remark: animated tiles are always rendered in the background
-         * layer.
-         */
-        if (! core->map->animated_tile_texture)
-        {
-            core->map->animated_tile_texture = SDL_CreateTexture(
-                window->renderer,
-                SDL_PIXELFORMAT_ARGB8888,
-                SDL_TEXTUREACCESS_TARGET,
-                (int32_t)(core->map->width),
-                (int32_t)(core->map->height));
-        }
+        return ESZ_OK;
+    }
 
-        if (! core->map->animated_tile_texture)
-        {
-            plog_error("%s: %s.", __func__, SDL_GetError());
-            return ESZ_ERROR_CRITICAL;
-        }
+    queue_layer(render_layer, window);
 
-        if (0 > SDL_SetRenderTarget(window->renderer, core->map->animated_tile_texture))
-        {
-            plog_error("%s: %s.", __func__, SDL_GetError());
-            return ESZ_ERROR_CRITICAL;
-        }
-        SDL_RenderClear(window->renderer);
+    get_visible_chunks(&first_index_width, &first_index_height, &last_index_width, &last_index_height, window, core);
 
-        for (int32_t index = 0; core->map->animated_tile_index > index; index += 1)
+    for (int32_t index_height = first_index_height; index_height <= last_index_height; index_height += 1)
+    {
+        for (int32_t index_width = first_index_width; index_width <= last_index_width; index_width += 1)
         {
-            esz_tiled_tileset_t* tileset;
-            int32_t              gid          = core->map->animated_tile[index].gid;
-            int32_t              next_tile_id = 0;
-            int32_t              local_id;
-            SDL_Rect             dst;
-            SDL_Rect             src;
+            esz_map_chunk_t*    chunk   = &core->map->chunk[(index_height * core->map->chunk_count_x) + index_width];
+            esz_tile_overlay_t* overlay = &chunk->animated_tile_overlay[level];
+            SDL_Texture*        texture;
+            SDL_Rect            dst;
+            SDL_Rect            src;
+            SDL_Rect            texture_src;
 
-            local_id = core->map->animated_tile[index].id + 1;
-            tileset  = get_head_tileset(core->map->handle);
-            src.w    = dst.w = get_tile_width(core->map->handle);
-            src.h    = dst.h = get_tile_height(core->map->handle);
-            dst.x    = (int32_t)core->map->animated_tile[index].dst_x;
-            dst.y    = (int32_t)core->map->animated_tile[index].dst_y;
+            chunk->last_render_frame = core->map->render_frame;
 
-            get_tile_position(local_id, &src.x, &src.y, core->map->handle);
-
-            if (0 > SDL_RenderCopy(window->renderer, core->map->tileset_texture, &src, &dst))
+            // Texture does not yet exist. Render it!
+            if (! chunk->layer_texture[level])
             {
-                plog_error("%s: %s.", __func__, SDL_GetError());
-                return ESZ_ERROR_CRITICAL;
+                if (ESZ_OK != bake_map_chunk(level, chunk, window, core))
+                {
+                    return ESZ_ERROR_CRITICAL;
+                }
             }
 
-            core->map->animated_tile[index].current_frame += 1;
-
-            if (core->map->animated_tile[index].current_frame >= core->map->animated_tile[index].animation_length)
+            if (render_animated_tiles && 0 < overlay->tile_count)
             {
-                core->map->animated_tile[index].current_frame = 0;
+                // Chunks outside of the viewport catch up once they
+                // become visible again.
+                if (! overlay->texture || overlay->tick != core->map->animated_tile_tick)
+                {
+                    if (ESZ_OK != render_animated_tiles_of_chunk(level, chunk, window, core))
+                    {
+                        return ESZ_ERROR_CRITICAL;
+                    }
+                }
             }
 
-            next_tile_id = get_next_animated_tile_id(gid, core->map->animated_tile[index].current_frame, core->map->handle);
+            texture = chunk->layer_texture[level];
 
-            core->map->animated_tile[index].id = next_tile_id;
-        }
+            src.x = 0;
+            src.y = 0;
+            src.w = chunk->width;
+            src.h = chunk->height;
+            dst.x = (int32_t)(core->map->pos_x - snapshot->camera_pos_x) + chunk->pos_x;
+            dst.y = (int32_t)(core->map->pos_y - snapshot->camera_pos_y) + chunk->pos_y;
+            dst.w = chunk->width;
+            dst.h = chunk->height;
 
-        if (0 > SDL_SetRenderTarget(window->renderer, core->map->render_target[render_layer]))
-        {
-            plog_error("%s: %s.", __func__, SDL_GetError());
-            return ESZ_ERROR_CRITICAL;
-        }
-        SDL_RenderClear(window->renderer);
+            // Only the chunk has downsampled copies; the animated tile
+            // overlay is always sampled at full resolution.
+            texture_src = src;
 
-        if (0 > SDL_SetTextureBlendMode(core->map->animated_tile_texture, SDL_BLENDMODE_BLEND))
-        {
-            plog_error("%s: %s.", __func__, SDL_GetError());
-            return ESZ_ERROR_CRITICAL;
-        }
-    }
+            // Zoomed out, a downsampled copy is cheaper to sample and doesn't shimmer.
+            if (0 < mip_level)
+            {
+                if (ESZ_OK != bake_map_chunk_mip(level, mip_level, chunk, window, core))
+                {
+                    return ESZ_ERROR_CRITICAL;
+                }
 
-    // Texture has already been rendered.
-    if (core->map->layer_texture[level])
-    {
-        double   render_pos_x = core->map->pos_x - core->camera.pos_x;
-        double   render_pos_y = core->map->pos_y - core->camera.pos_y;
-        SDL_Rect dst          = {
-            (int32_t)render_pos_x,
-            (int32_t)render_pos_y,
-            (int32_t)core->map->width,
-            (int32_t)core->map->height
-        };
+                texture = chunk->mip_texture[(level * ESZ_MAP_CHUNK_MIP_MAX) + mip_level - 1];
+                SDL_QueryTexture(texture, NULL, NULL, &texture_src.w, &texture_src.h);
+            }
 
-        if (0 > SDL_RenderCopyEx(window->renderer, core->map->layer_texture[level], NULL, &dst, 0, NULL, SDL_FLIP_NONE))
-        {
-            plog_error("%s: %s.", __func__, SDL_GetError());
-            return ESZ_ERROR_CRITICAL;
-        }
+            if (ESZ_OK != queue_quad(render_layer, texture, &texture_src, &dst, SDL_FLIP_NONE, window))
+            {
+                return ESZ_ERROR_CRITICAL;
+            }
 
-        if (render_animated_tiles)
-        {
-            if (core->map->animated_tile_texture)
+            if (render_animated_tiles && overlay->texture)
             {
-                if (0 > SDL_RenderCopyEx(window->renderer, core->map->animated_tile_texture, NULL, &dst, 0, NULL, SDL_FLIP_NONE))
+                if (ESZ_OK != queue_quad(render_layer, overlay->texture, &src, &dst, SDL_FLIP_NONE, window))
                 {
-                    plog_error("%s: %s.", __func__, SDL_GetError());
                     return ESZ_ERROR_CRITICAL;
                 }
             }
         }
-
-        return ESZ_OK;
     }
 
-    // Texture does not yet exist. Render it!
-    core->map->layer_texture[level] = SDL_CreateTexture(
-        window->renderer,
-        SDL_PIXELFORMAT_ARGB8888,
-        SDL_TEXTUREACCESS_TARGET,
-        (int32_t)core->map->width,
-        (int32_t)core->map->height);
+    return ESZ_OK;
+}
 
-    if (! core->map->layer_texture[level])
+void release_render_targets(esz_window_t* window, esz_core_t* core)
+{
+    // The window keeps them for the next map or the next frame.
+    for (int32_t index = 0; index < ESZ_RENDER_LAYER_MAX; index += 1)
     {
-        plog_error("%s: %s.", __func__, SDL_GetError());
-        return ESZ_ERROR_CRITICAL;
+        release_render_target(&core->map->render_target[index], window);
     }
+}
 
-    if (0 > SDL_SetRenderTarget(window->renderer, core->map->layer_texture[level]))
-    {
-        plog_error("%s: %s.", __func__, SDL_GetError());
-        return ESZ_ERROR_CRITICAL;
-    }
-    SDL_RenderClear(window->renderer);
+esz_status render_scene(esz_window_t* window, esz_core_t* core)
+{
+    esz_status status         = ESZ_OK;
+    bool       is_map_redrawn = false;
 
-    while (layer)
+    SDL_memset(&core->render_stats, 0, sizeof(struct esz_render_stats));
+    clear_queue(window);
+
+    if (core->is_map_loaded)
     {
-        SDL_Rect dst;
-        SDL_Rect src;
+        esz_snapshot_t* snapshot;
+        int32_t         target_width;
+        int32_t         target_height;
 
-        if (is_tiled_layer_of_type(ESZ_TILE_LAYER, layer, core))
+        get_render_target_size(&target_width, &target_height, window);
+
+        // Pick up the latest state published by the simulation.
+        acquire_snapshot(core);
+        snapshot = get_render_snapshot(core);
+
+        core->map->render_frame += 1;
+
+        /* The render targets have to follow the logical size and the
+         * render scale.  They are allocated with some headroom, so that
+         * a zoom animation doesn't reallocate them every frame; pooled
+         * targets of the old size are dropped.
+         */
+        if (! is_render_target_size_valid(target_width, target_height, core))
         {
-            bool    is_in_foreground  = false;
-            bool    is_layer_rendered = false;
-            int32_t prop_cnt = get_layer_property_count(layer);
+            release_render_targets(window, core);
 
-            is_in_foreground = get_boolean_property(H_is_in_foreground, layer->properties, prop_cnt, core);
+            core->map->render_target_width  = get_render_target_bucket(target_width);
+            core->map->render_target_height = get_render_target_bucket(target_height);
 
-            if (ESZ_MAP_LAYER_BG == level && false == is_in_foreground)
+            trim_render_target_pool(core->map->render_target_width, core->map->render_target_height, window);
+        }
+
+        // Everything is drawn relative to the camera and its zoom level.
+        if (core->map->last_camera_pos_x != snapshot->camera_pos_x ||
+            core->map->last_camera_pos_y != snapshot->camera_pos_y ||
+            core->map->last_zoom_level   != window->zoom_level)
+        {
+            core->map->render_layer_dirty = (1 << ESZ_RENDER_LAYER_MAX) - 1;
+            core->map->last_camera_pos_x  = snapshot->camera_pos_x;
+            core->map->last_camera_pos_y  = snapshot->camera_pos_y;
+            core->map->last_zoom_level    = window->zoom_level;
+        }
+
+        for (int32_t level = 0; level < core->map->level_count; level += 1)
+        {
+            if (! is_render_layer_clean(core->map->level_render_layer[level], window, core))
             {
-                is_layer_rendered = true;
+                is_map_redrawn = true;
             }
-            else if (ESZ_MAP_LAYER_FG == level && is_in_foreground)
+        }
+
+        if (window->direct_composition_enabled)
+        {
+            if (0 > SDL_SetRenderTarget(window->renderer, NULL))
             {
-                is_layer_rendered = true;
+                plog_error("%s: %s.", __func__, SDL_GetError());
+                return ESZ_ERROR_CRITICAL;
             }
 
-            if (layer->visible && is_layer_rendered)
-            {
-                for (int32_t index_height = 0; index_height < (int32_t)core->map->handle->height; index_height += 1)
-                {
-                    for (int32_t index_width = 0; index_width < (int32_t)core->map->handle->width; index_width += 1)
-                    {
-                        int32_t* layer_content = get_layer_content(layer);
-                        int32_t  gid           = remove_gid_flip_bits((int32_t)layer_content[(index_height * (int32_t)core->map->handle->width) + index_width]);
-                        int32_t  local_id      = gid - get_first_gid(core->map->handle);
-
-                        if (is_gid_valid(gid, core->map->handle))
-                        {
-                            esz_tiled_tileset_t* tileset = get_head_tileset(core->map->handle);
-
-                            src.w = dst.w = get_tile_width(core->map->handle);
-                            src.h = dst.h = get_tile_height(core->map->handle);
-                            dst.x = (int32_t)(index_width  * get_tile_width(core->map->handle));
-                            dst.y = (int32_t)(index_height * get_tile_height(core->map->handle));
-
-                            get_tile_position(gid, &src.x, &src.y, core->map->handle);
-                            SDL_RenderCopy(window->renderer, core->map->tileset_texture, &src, &dst);
-
-                            if (render_animated_tiles)
-                            {
-                                int32_t animation_length = 0;
-                                int32_t id               = 0;
-
-                                if (is_tile_animated(gid, &animation_length, &id, core->map->handle))
-                                {
-                                    core->map->animated_tile[core->map->animated_tile_index].gid              = get_local_id(gid, core->map->handle);
-                                    core->map->animated_tile[core->map->animated_tile_index].id               = id;
-                                    core->map->animated_tile[core->map->animated_tile_index].dst_x            = dst.x;
-                                    core->map->animated_tile[core->map->animated_tile_index].dst_y            = dst.y;
-                                    core->map->animated_tile[core->map->animated_tile_index].current_frame    = 0;
-                                    core->map->animated_tile[core->map->animated_tile_index].animation_length = animation_length;
-
-                                    core->map->animated_tile_index += 1;
-                                }
-                            }
-                        }
-                    }
-                }
+            SDL_SetRenderDrawColor(
+                window->renderer,
+                (core->map->handle->backgroundcolor >> 16) & 0xFF,
+                (core->map->handle->backgroundcolor >> 8)  & 0xFF,
+                (core->map->handle->backgroundcolor)       & 0xFF,
+                SDL_ALPHA_OPAQUE);
 
-                {
-                    const char* layer_name = get_layer_name(layer);
-                    plog_info("Render map layer: %s", layer_name);
-                }
-            }
+            SDL_RenderClear(window->renderer);
         }
-        layer = layer->next;
     }
 
-    if (0 > SDL_SetRenderTarget(window->renderer, core->map->render_target[render_layer]))
+    status = render_background(window, core);
+    if (ESZ_OK != status)
     {
-        plog_error("%s: %s.", __func__, SDL_GetError());
-        return ESZ_ERROR_CRITICAL;
+        return status;
     }
 
-    if (0 > SDL_SetTextureBlendMode(core->map->layer_texture[level], SDL_BLENDMODE_BLEND))
+    /* The draw order is walked once; each render layer receives its
+     * draw commands in one contiguous run, so the render queue keeps
+     * them in order.
+     */
+    for (int32_t index = 0; core->is_map_loaded && index < core->map->draw_layer_count; index += 1)
     {
-        plog_error("%s: %s.", __func__, SDL_GetError());
-        return ESZ_ERROR_CRITICAL;
+        esz_draw_layer_t* draw_layer = &core->map->draw_layer[index];
+
+        if (ESZ_DRAW_MAP_LEVEL == draw_layer->type)
+        {
+            status = render_map(draw_layer->level, window, core);
+        }
+        else
+        {
+            status = render_actors(draw_layer, window, core);
+        }
+
+        if (ESZ_OK != status)
+        {
+            return status;
+        }
+    }
+
+    // Chunks are only baked while a map level is redrawn.
+    if (core->is_map_loaded && is_map_redrawn)
+    {
+        evict_map_chunks(window, core);
+    }
+
+    status = submit_queue(window, core);
+    if (ESZ_OK != status)
+    {
+        return status;
+    }
+
+    if (core->is_map_loaded)
+    {
+        // Spend a little time per frame on the surrounding chunks.
+        if (0.0 < core->chunk_bake_time)
+        {
+            status = bake_nearby_map_chunks(core->chunk_bake_time, ESZ_MAP_CHUNK_BAKE_MARGIN, window, core);
+        }
+
+        core->map->render_layer_dirty = 0;
+    }
+
+    return status;
+}
+
+static esz_status render_background_layer(int32_t index, esz_window_t* window, esz_core_t* core)
+{
+    esz_background_layer_t* layer        = &core->map->background.layer[index];
+    esz_snapshot_t*         snapshot     = get_render_snapshot(core);
+    esz_render_layer        render_layer = ESZ_BACKGROUND;
+    SDL_Rect                dst;
+    SDL_Rect                src;
+
+    if (ESZ_TOP == core->map->background.alignment)
+    {
+        dst.y = (int32_t)(layer->pos_y - snapshot->camera_pos_y);
+    }
+    else
+    {
+        dst.y = (int32_t)(layer->pos_y + (window->logical_height - layer->height));
+    }
+
+    if (0 >= layer->width)
+    {
+        return ESZ_OK;
+    }
+
+    src.x = 0;
+    src.y = 0;
+    src.w = layer->width;
+    src.h = layer->height;
+
+    // Start with the left-most copy that is still partially visible.
+    dst.x = (int32_t)fmod(snapshot->background_pos_x[index], (double)layer->width);
+    dst.w = layer->width;
+    dst.h = layer->height;
+
+    if (0 < dst.x)
+    {
+        dst.x -= layer->width;
+    }
+
+    while (dst.x < window->logical_width)
+    {
+        if (ESZ_OK != queue_quad(render_layer, layer->texture, &src, &dst, SDL_FLIP_NONE, window))
+        {
+            return ESZ_ERROR_CRITICAL;
+        }
+
+        dst.x += layer->width;
     }
 
     return ESZ_OK;
 }
 
-esz_status render_scene(esz_window_t* window, esz_core_t* core)
+static esz_status bake_map_chunk(int32_t level, esz_map_chunk_t* chunk, esz_window_t* window, esz_core_t* core)
 {
-    esz_status status = ESZ_OK;
+    esz_status         status             = ESZ_OK;
+    esz_tiled_layer_t* layer;
+    int32_t            tile_width         = get_tile_width(core->map->handle);
+    int32_t            tile_height        = get_tile_height(core->map->handle);
+    int32_t            first_index_width  = chunk->pos_x / tile_width;
+    int32_t            first_index_height = chunk->pos_y / tile_height;
+    int32_t            last_index_width   = (chunk->pos_x + chunk->width  - 1) / tile_width;
+    int32_t            last_index_height  = (chunk->pos_y + chunk->height - 1) / tile_height;
+    int32_t            cell_count_x       = last_index_width  - first_index_width  + 1;
+    int32_t            cell_count         = cell_count_x * (last_index_height - first_index_height + 1);
+    int32_t            chunk_index        = (int32_t)(chunk - core->map->chunk);
+    int32_t            layer_index;
+    int32_t*           base_layer;
+    int32_t*           base_gid;
+    bool               is_opaque          = true;
+
+    // The top-most opaque tile of each cell hides everything below it.
+    base_layer = (int32_t*)malloc((size_t)cell_count * 2 * sizeof(int32_t));
+    if (! base_layer)
+    {
+        plog_error("%s: error allocating memory.", __func__);
+        return ESZ_ERROR_CRITICAL;
+    }
+
+    base_gid = base_layer + cell_count;
+
+    for (int32_t index = 0; index < cell_count; index += 1)
+    {
+        base_layer[index] = -1;
+    }
+
+    if (ESZ_OK != create_map_chunk_texture(&chunk->layer_texture[level], 0, chunk, window, core))
+    {
+        status = ESZ_ERROR_CRITICAL;
+        goto exit;
+    }
+
+    layer       = get_head_layer(core->map->handle);
+    layer_index = 0;
+
+    while (layer)
+    {
+        if (level == core->map->tile_layer_level[layer_index])
+        {
+            esz_tile_layer_index_t* tile_layer_index = &core->map->tile_layer_index[layer_index];
+            int32_t*                layer_content    = get_layer_content(layer);
+
+            // Only the occupied cells of this chunk are visited.
+            for (int32_t index = tile_layer_index->chunk_offset[chunk_index]; index < tile_layer_index->chunk_offset[chunk_index + 1]; index += 1)
+            {
+                int32_t tile_index   = tile_layer_index->cell[index];
+                int32_t index_width  = tile_index % (int32_t)core->map->handle->width;
+                int32_t index_height = tile_index / (int32_t)core->map->handle->width;
+                int32_t gid          = remove_gid_flip_bits((int32_t)layer_content[tile_index]);
+                int32_t cell         = ((index_height - first_index_height) * cell_count_x) + (index_width - first_index_width);
+
+                if (TILE_OPAQUE == get_tile_opacity(gid, core))
+                {
+                    base_layer[cell] = layer_index;
+                    base_gid[cell]   = gid;
+                }
+            }
+        }
+        layer_index += 1;
+        layer        = layer->next;
+    }
+
+    // Opaque tiles are copied without blending.
+    set_tileset_blend_mode(SDL_BLENDMODE_NONE, core);
+
+    for (int32_t cell = 0; cell < cell_count; cell += 1)
+    {
+        esz_tile_source_t* tile_source;
+        SDL_Rect           dst;
+
+        if (0 > base_layer[cell])
+        {
+            is_opaque = false;
+            continue;
+        }
+
+        tile_source = &core->map->tile_source[base_gid[cell]];
+
+        dst.w = tile_width;
+        dst.h = tile_height;
+        dst.x = ((first_index_width  + (cell % cell_count_x)) * tile_width)  - chunk->pos_x;
+        dst.y = ((first_index_height + (cell / cell_count_x)) * tile_height) - chunk->pos_y;
+
+        if (ESZ_OK != batch_quad(tile_source->texture, &tile_source->src, &dst, SDL_FLIP_NONE, window))
+        {
+            status = ESZ_ERROR_CRITICAL;
+            break;
+        }
+    }
+
+    if (ESZ_OK != flush_batch(window))
+    {
+        status = ESZ_ERROR_CRITICAL;
+    }
+
+    set_tileset_blend_mode(SDL_BLENDMODE_BLEND, core);
 
-    status = render_background(window, core);
     if (ESZ_OK != status)
     {
-        return status;
+        goto exit;
     }
 
-    for (int32_t index = 0; index < ESZ_MAP_LAYER_LEVEL_MAX; index  += 1)
+    // Translucent tiles on top are blended as usual; empty ones are skipped.
+    layer       = get_head_layer(core->map->handle);
+    layer_index = 0;
+
+    while (layer)
     {
-        status = render_map(index, window, core);
-        if (ESZ_OK != status)
+        if (level == core->map->tile_layer_level[layer_index])
         {
-            return status;
+            esz_tile_layer_index_t* tile_layer_index = &core->map->tile_layer_index[layer_index];
+            int32_t*                layer_content    = get_layer_content(layer);
+
+            for (int32_t index = tile_layer_index->chunk_offset[chunk_index]; index < tile_layer_index->chunk_offset[chunk_index + 1]; index += 1)
+            {
+                int32_t  tile_index   = tile_layer_index->cell[index];
+                int32_t  index_width  = tile_index % (int32_t)core->map->handle->width;
+                int32_t  index_height = tile_index / (int32_t)core->map->handle->width;
+                int32_t  gid          = remove_gid_flip_bits((int32_t)layer_content[tile_index]);
+                int32_t  cell         = ((index_height - first_index_height) * cell_count_x) + (index_width - first_index_width);
+                esz_tile_source_t* tile_source;
+                SDL_Rect           dst;
+
+                if (layer_index <= base_layer[cell] || TILE_EMPTY == get_tile_opacity(gid, core))
+                {
+                    continue;
+                }
+
+                tile_source = &core->map->tile_source[gid];
+
+                dst.w = tile_width;
+                dst.h = tile_height;
+                dst.x = (index_width  * tile_width)  - chunk->pos_x;
+                dst.y = (index_height * tile_height) - chunk->pos_y;
+
+                if (ESZ_OK != batch_quad(tile_source->texture, &tile_source->src, &dst, SDL_FLIP_NONE, window))
+                {
+                    status = ESZ_ERROR_CRITICAL;
+                    goto exit;
+                }
+            }
         }
+        layer_index += 1;
+        layer        = layer->next;
     }
 
-    for (int32_t index = 0; index < ESZ_ACTOR_LAYER_LEVEL_MAX; index += 1)
+    if (ESZ_OK != flush_batch(window))
     {
-        status = render_actors(index, window, core);
+        status = ESZ_ERROR_CRITICAL;
+        goto exit;
+    }
+
+    // A fully covered chunk replaces whatever is below it.
+    SDL_SetTextureBlendMode(chunk->layer_texture[level], is_opaque ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
+
+    plog_debug("Bake map chunk at %d,%d (level %d).", chunk->pos_x, chunk->pos_y, level);
+
+exit:
+    free(base_layer);
+    return status;
+}
+
+static esz_status bake_map_chunk_mip(int32_t level, int32_t mip_level, esz_map_chunk_t* chunk, esz_window_t* window, esz_core_t* core)
+{
+    /* Each copy is scaled down from the previous one by exactly half,
+     * so that linear filtering averages four texels at a time.
+     */
+    for (int32_t index = 0; index < mip_level; index += 1)
+    {
+        esz_status    status = ESZ_OK;
+        SDL_Texture*  source = chunk->layer_texture[level];
+        SDL_BlendMode blend_mode;
+        SDL_ScaleMode scale_mode;
+
+        if (chunk->mip_texture[(level * ESZ_MAP_CHUNK_MIP_MAX) + index])
+        {
+            continue;
+        }
+
+        if (0 < index)
+        {
+            source = chunk->mip_texture[(level * ESZ_MAP_CHUNK_MIP_MAX) + index - 1];
+        }
+
+        if (ESZ_OK != create_map_chunk_texture(&chunk->mip_texture[(level * ESZ_MAP_CHUNK_MIP_MAX) + index], index + 1, chunk, window, core))
+        {
+            return ESZ_ERROR_CRITICAL;
+        }
+
+        SDL_GetTextureBlendMode(source, &blend_mode);
+        SDL_GetTextureScaleMode(source, &scale_mode);
+        SDL_SetTextureBlendMode(source, SDL_BLENDMODE_NONE);
+        SDL_SetTextureScaleMode(source, SDL_ScaleModeLinear);
+
+        if (0 > SDL_RenderCopy(window->renderer, source, NULL, NULL))
+        {
+            plog_error("%s: %s.", __func__, SDL_GetError());
+            status = ESZ_ERROR_CRITICAL;
+        }
+
+        SDL_SetTextureBlendMode(source, blend_mode);
+        SDL_SetTextureScaleMode(source, scale_mode);
+        SDL_SetTextureBlendMode(chunk->mip_texture[(level * ESZ_MAP_CHUNK_MIP_MAX) + index], blend_mode);
+
         if (ESZ_OK != status)
         {
             return status;
         }
     }
 
-    return status;
+    return ESZ_OK;
 }
 
-static esz_status render_background_layer(int32_t index, esz_window_t* window, esz_core_t* core)
+static esz_status create_map_chunk_texture(SDL_Texture** texture, int32_t mip_level, esz_map_chunk_t* chunk, esz_window_t* window, esz_core_t* core)
 {
-    esz_render_layer render_layer = ESZ_BACKGROUND;
-    int32_t          width        = 0;
-    SDL_Rect         dst;
-    double           pos_x_a;
-    double           pos_x_b;
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+    uint8_t alpha;
 
-    if (0 > SDL_QueryTexture(core->map->background.layer[index].texture, NULL, NULL, &width, NULL))
+    if (! (*texture))
+    {
+        int32_t width  = (chunk->width  + (1 << mip_level) - 1) >> mip_level;
+        int32_t height = (chunk->height + (1 << mip_level) - 1) >> mip_level;
+        size_t  size   = (size_t)width * (size_t)height * 4;
+
+        // Older chunks give way to the ones that are needed now.
+        while (is_texture_budget_exceeded(size, window) && evict_map_chunk(window, core))
+        {
+            continue;
+        }
+
+        /* If the driver runs out of memory nevertheless, keep evicting
+         * until the texture fits or there is nothing left to evict.
+         */
+        while (ESZ_OK != create_texture(texture, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, width, height, window))
+        {
+            if (! evict_map_chunk(window, core))
+            {
+                return ESZ_ERROR_CRITICAL;
+            }
+        }
+
+        core->map->chunk_memory_usage += size;
+
+        if (0 > SDL_SetTextureBlendMode((*texture), SDL_BLENDMODE_BLEND))
+        {
+            plog_error("%s: %s.", __func__, SDL_GetError());
+            destroy_map_chunk_texture(texture, window, core);
+            return ESZ_ERROR_CRITICAL;
+        }
+    }
+
+    if (0 > SDL_SetRenderTarget(window->renderer, (*texture)))
     {
         plog_error("%s: %s.", __func__, SDL_GetError());
         return ESZ_ERROR_CRITICAL;
     }
 
-    if (core->map->background.layer[index].pos_x < -width)
+    // Chunks are always cleared to transparent black.
+    SDL_GetRenderDrawColor(window->renderer, &red, &green, &blue, &alpha);
+    SDL_SetRenderDrawColor(window->renderer, 0x00, 0x00, 0x00, SDL_ALPHA_TRANSPARENT);
+    SDL_RenderClear(window->renderer);
+    SDL_SetRenderDrawColor(window->renderer, red, green, blue, alpha);
+
+    return ESZ_OK;
+}
+
+static void destroy_map_chunk_mips(int32_t level, esz_map_chunk_t* chunk, esz_window_t* window, esz_core_t* core)
+{
+    for (int32_t index = 0; index < ESZ_MAP_CHUNK_MIP_MAX; index += 1)
     {
-        core->map->background.layer[index].pos_x = +width;
+        destroy_map_chunk_texture(&chunk->mip_texture[(level * ESZ_MAP_CHUNK_MIP_MAX) + index], window, core);
     }
+}
 
-    if (core->map->background.layer[index].pos_x > +width)
+static void destroy_map_chunk_texture(SDL_Texture** texture, esz_window_t* window, esz_core_t* core)
+{
+    if (*texture)
     {
-        core->map->background.layer[index].pos_x = -width;
+        core->map->chunk_memory_usage -= get_texture_size((*texture));
+
+        destroy_texture(texture, window);
     }
+}
+
+static bool evict_map_chunk(esz_window_t* window, esz_core_t* core)
+{
+    esz_map_chunk_t* oldest_chunk = NULL;
 
-    pos_x_a = core->map->background.layer[index].pos_x;
-    if (0 < pos_x_a)
+    for (int32_t index = 0; index < (core->map->chunk_count_x * core->map->chunk_count_y); index += 1)
     {
-        pos_x_b = pos_x_a - width;
+        esz_map_chunk_t* chunk       = &core->map->chunk[index];
+        bool             is_resident = false;
+
+        // Chunks that are visible in the current frame are never evicted.
+        if (chunk->last_render_frame == core->map->render_frame)
+        {
+            continue;
+        }
+
+        for (int32_t level = 0; level < core->map->level_count; level += 1)
+        {
+            if (chunk->layer_texture[level] || chunk->animated_tile_overlay[level].texture)
+            {
+                is_resident = true;
+            }
+        }
+
+        if (is_resident && (! oldest_chunk || chunk->last_render_frame < oldest_chunk->last_render_frame))
+        {
+            oldest_chunk = chunk;
+        }
     }
-    else
+
+    if (! oldest_chunk)
     {
-        pos_x_b = pos_x_a + width;
+        return false;
     }
 
-    if (0 < core->map->background.layer[index].velocity)
+    for (int32_t level = 0; level < core->map->level_count; level += 1)
     {
-        if (ESZ_RIGHT == core->map->background.direction)
-        {
-            core->map->background.layer[index].pos_x -= core->map->background.layer[index].velocity;
-        }
-        else
+        destroy_map_chunk_mips(level, oldest_chunk, window, core);
+        destroy_map_chunk_texture(&oldest_chunk->layer_texture[level], window, core);
+        destroy_map_chunk_texture(&oldest_chunk->animated_tile_overlay[level].texture, window, core);
+    }
+
+    plog_debug("Evict map chunk at %d,%d.", oldest_chunk->pos_x, oldest_chunk->pos_y);
+    return true;
+}
+
+static void evict_map_chunks(esz_window_t* window, esz_core_t* core)
+{
+    // Both the chunk budget and the overall texture budget are honoured.
+    while (core->map->chunk_memory_usage > core->chunk_memory_budget || is_texture_budget_exceeded(0, window))
+    {
+        if (! evict_map_chunk(window, core))
         {
-            core->map->background.layer[index].pos_x += core->map->background.layer[index].velocity;
+            break;
         }
     }
+}
 
-    if (ESZ_TOP == core->map->background.alignment)
+static void get_visible_chunks(int32_t* first_index_width, int32_t* first_index_height, int32_t* last_index_width, int32_t* last_index_height, esz_window_t* window, esz_core_t* core)
+{
+    esz_snapshot_t* snapshot = get_render_snapshot(core);
+    double          pos_x    = snapshot->camera_pos_x - core->map->pos_x;
+    double          pos_y    = snapshot->camera_pos_y - core->map->pos_y;
+
+    *first_index_width  = (int32_t)floor(pos_x / (double)ESZ_MAP_CHUNK_SIZE);
+    *first_index_height = (int32_t)floor(pos_y / (double)ESZ_MAP_CHUNK_SIZE);
+    *last_index_width   = (int32_t)floor((pos_x + (double)window->logical_width  - 1.0) / (double)ESZ_MAP_CHUNK_SIZE);
+    *last_index_height  = (int32_t)floor((pos_y + (double)window->logical_height - 1.0) / (double)ESZ_MAP_CHUNK_SIZE);
+
+    *first_index_width  = SDL_max(*first_index_width,  0);
+    *first_index_height = SDL_max(*first_index_height, 0);
+    *last_index_width   = SDL_min(*last_index_width,   core->map->chunk_count_x - 1);
+    *last_index_height  = SDL_min(*last_index_height,  core->map->chunk_count_y - 1);
+}
+
+static bool is_render_layer_clean(esz_render_layer render_layer, esz_window_t* window, esz_core_t* core)
+{
+    /* A render target keeps its contents until something on its layer
+     * has changed.  The window is cleared every frame though, so
+     * without render targets there is nothing to keep.
+     */
+    if (window->direct_composition_enabled || ! core->map->render_target[render_layer])
     {
-        dst.y = (int32_t)(core->map->background.layer[index].pos_y - core->camera.pos_y);
+        return false;
     }
-    else
+
+    return ! IS_STATE_SET(core->map->render_layer_dirty, render_layer);
+}
+
+static bool is_render_layer_skipped(esz_render_layer render_layer, esz_window_t* window, esz_core_t* core)
+{
+    /* Hidden layers are still rendered into their render target and
+     * skipped when composing the scene.  Without render targets, they
+     * have to be skipped right away.
+     */
+    if (window->direct_composition_enabled && IS_STATE_SET(core->debug, render_layer))
     {
-        dst.y = (int32_t)(core->map->background.layer[index].pos_y + (window->logical_height - core->map->background.layer[index].height));
+        return true;
     }
 
-    if (0 > SDL_SetRenderTarget(window->renderer, core->map->render_target[render_layer]))
+    return false;
+}
+
+static bool is_render_target_size_valid(int32_t width, int32_t height, esz_core_t* core)
+{
+    /* The scene only covers the top-left part of the render targets;
+     * they are kept as long as it fits and uses more than half of
+     * them.
+     */
+    if (width  > core->map->render_target_width  || (width  * 2) < core->map->render_target_width ||
+        height > core->map->render_target_height || (height * 2) < core->map->render_target_height)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+static esz_status render_animated_tiles_of_chunk(int32_t level, esz_map_chunk_t* chunk, esz_window_t* window, esz_core_t* core)
+{
+    esz_tile_overlay_t* overlay     = &chunk->animated_tile_overlay[level];
+    int32_t             tile_width  = get_tile_width(core->map->handle);
+    int32_t             tile_height = get_tile_height(core->map->handle);
+    int32_t             last_index  = overlay->tile_offset + overlay->tile_count;
+    bool                is_redrawn  = false;
+    uint8_t             red;
+    uint8_t             green;
+    uint8_t             blue;
+    uint8_t             alpha;
+    SDL_BlendMode       blend_mode;
+
+    if (! overlay->texture)
+    {
+        if (ESZ_OK != create_map_chunk_texture(&overlay->texture, 0, chunk, window, core))
+        {
+            return ESZ_ERROR_CRITICAL;
+        }
+        is_redrawn = true;
+    }
+    else if (0 > SDL_SetRenderTarget(window->renderer, overlay->texture))
     {
         plog_error("%s: %s.", __func__, SDL_GetError());
         return ESZ_ERROR_CRITICAL;
     }
 
-    if (0 == index)
+    // Changed cells are overwritten with transparent black.
+    SDL_GetRenderDrawColor(window->renderer, &red, &green, &blue, &alpha);
+    SDL_GetRenderDrawBlendMode(window->renderer, &blend_mode);
+    SDL_SetRenderDrawColor(window->renderer, 0x00, 0x00, 0x00, SDL_ALPHA_TRANSPARENT);
+    SDL_SetRenderDrawBlendMode(window->renderer, SDL_BLENDMODE_NONE);
+
+    for (int32_t index = overlay->tile_offset; index < last_index;)
     {
-        SDL_SetRenderDrawColor(
-            window->renderer,
-            (core->map->handle->backgroundcolor >> 16) & 0xFF,
-            (core->map->handle->backgroundcolor >> 8)  & 0xFF,
-            (core->map->handle->backgroundcolor)       & 0xFF,
-            0);
+        esz_animated_tile_t* cell       = &core->map->animated_tile[index];
+        int32_t              cell_count = 0;
+        bool                 is_changed = is_redrawn;
+        SDL_Rect             dst;
+
+        // Catch up with the timelines of all tiles stacked on this cell.
+        while (index + cell_count < last_index &&
+               core->map->animated_tile[index + cell_count].dst_x == cell->dst_x &&
+               core->map->animated_tile[index + cell_count].dst_y == cell->dst_y)
+        {
+            esz_animated_tile_t*  animated_tile  = &core->map->animated_tile[index + cell_count];
+            esz_tile_animation_t* tile_animation = &core->map->tile_animation[animated_tile->animation];
 
-        SDL_RenderClear(window->renderer);
+            if (tile_animation->current_frame != animated_tile->current_frame)
+            {
+                animated_tile->current_frame = tile_animation->current_frame;
+                is_changed                   = true;
+            }
+            cell_count += 1;
+        }
+
+        if (is_changed)
+        {
+            dst.w = tile_width;
+            dst.h = tile_height;
+            dst.x = cell->dst_x - chunk->pos_x;
+            dst.y = cell->dst_y - chunk->pos_y;
+
+            /* Clearing happens right away while the tiles are batched.
+             * This is fine, because cells never overlap and the batch is
+             * always flushed after the clear of its own cell.
+             */
+            if (! is_redrawn)
+            {
+                SDL_RenderFillRect(window->renderer, &dst);
+            }
+
+            for (int32_t cell_index = index; cell_index < (index + cell_count); cell_index += 1)
+            {
+                esz_animated_tile_t*  animated_tile  = &core->map->animated_tile[cell_index];
+                esz_tile_animation_t* tile_animation = &core->map->tile_animation[animated_tile->animation];
+                int32_t               frame_gid      = tile_animation->frame[animated_tile->current_frame];
+                esz_tile_source_t*    tile_source;
+
+                if (TILE_EMPTY == get_tile_opacity(frame_gid, core))
+                {
+                    continue;
+                }
+
+                tile_source = &core->map->tile_source[frame_gid];
+
+                if (ESZ_OK != batch_quad(tile_source->texture, &tile_source->src, &dst, SDL_FLIP_NONE, window))
+                {
+                    return ESZ_ERROR_CRITICAL;
+                }
+            }
+        }
+
+        index += cell_count;
     }
 
-    dst.x = (int32_t)pos_x_a;
-    dst.w = width;
-    dst.h = core->map->background.layer[index].height;
+    SDL_SetRenderDrawColor(window->renderer, red, green, blue, alpha);
+    SDL_SetRenderDrawBlendMode(window->renderer, blend_mode);
+
+    overlay->tick = core->map->animated_tile_tick;
 
-    if (0 > SDL_RenderCopyEx(window->renderer, core->map->background.layer[index].texture, NULL, &dst, 0, NULL, SDL_FLIP_NONE))
+    return flush_batch(window);
+}
+
+static esz_status set_render_layer_target(esz_render_layer render_layer, esz_window_t* window, esz_core_t* core)
+{
+    if (window->direct_composition_enabled)
     {
-        plog_error("%s: %s.", __func__, SDL_GetError());
-        return ESZ_ERROR_CRITICAL;
+        if (0 > SDL_SetRenderTarget(window->renderer, NULL))
+        {
+            plog_error("%s: %s.", __func__, SDL_GetError());
+            return ESZ_ERROR_CRITICAL;
+        }
+
+        return ESZ_OK;
     }
 
-    dst.x = (int32_t)pos_x_b;
-    if (0 > SDL_RenderCopyEx(window->renderer, core->map->background.layer[index].texture, NULL, &dst, 0, NULL, SDL_FLIP_NONE))
+    if (ESZ_OK != create_and_set_render_target(&core->map->render_target[render_layer], window, core))
     {
-        plog_error("%s: %s.", __func__, SDL_GetError());
         return ESZ_ERROR_CRITICAL;
     }
 
+    // The scene is still drawn in logical coordinates.
+    if (1.0 != window->render_scale)
+    {
+        SDL_RenderSetScale(window->renderer, (float)window->render_scale, (float)window->render_scale);
+    }
+
     return ESZ_OK;
 }
+
+static void set_tileset_blend_mode(SDL_BlendMode blend_mode, esz_core_t* core)
+{
+    // Several tilesets may share the same atlas page.
+    for (int32_t index = 0; index < core->map->tileset_count; index += 1)
+    {
+        SDL_SetTextureBlendMode(core->map->tileset[index].texture, blend_mode);
+    }
+}
+
+static esz_status submit_queue(esz_window_t* window, esz_core_t* core)
+{
+    esz_render_queue_t* queue   = &window->queue;
+    esz_status          status  = ESZ_OK;
+    SDL_Texture*        texture = NULL;
+    int32_t             index   = 0;
+
+    sort_queue(window);
+
+    for (int32_t render_layer = 0; render_layer < ESZ_RENDER_LAYER_MAX; render_layer += 1)
+    {
+        // Layers that are not redrawn keep the contents of their target.
+        if (! IS_STATE_SET(queue->layer_mask, render_layer))
+        {
+            continue;
+        }
+
+        if (ESZ_OK != set_render_layer_target((esz_render_layer)render_layer, window, core))
+        {
+            status = ESZ_ERROR_CRITICAL;
+            break;
+        }
+
+        // In direct composition mode, the window is cleared by render_scene().
+        if (ESZ_BACKGROUND == render_layer && ! window->direct_composition_enabled)
+        {
+            SDL_SetRenderDrawColor(
+                window->renderer,
+                (core->map->handle->backgroundcolor >> 16) & 0xFF,
+                (core->map->handle->backgroundcolor >> 8)  & 0xFF,
+                (core->map->handle->backgroundcolor)       & 0xFF,
+                0);
+
+            SDL_RenderClear(window->renderer);
+        }
+
+        while (index < queue->command_count && render_layer == (int32_t)queue->command[index].layer)
+        {
+            esz_render_command_t* command = &queue->command[index];
+
+            if (texture != command->texture)
+            {
+                texture                             = command->texture;
+                core->render_stats.texture_switches += 1;
+            }
+
+            if (ESZ_OK != batch_quad(command->texture, &command->src, &command->dst, command->flip, window))
+            {
+                status = ESZ_ERROR_CRITICAL;
+                goto exit;
+            }
+
+            core->render_stats.commands_submitted += 1;
+            index                                 += 1;
+        }
+
+        if (ESZ_OK != flush_batch(window))
+        {
+            status = ESZ_ERROR_CRITICAL;
+            break;
+        }
+    }
+
+exit:
+    clear_queue(window);
+    return status;
+}
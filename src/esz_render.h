@@ -7,16 +7,22 @@
 #ifndef ESZ_RENDER_H
 #define ESZ_RENDER_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "esz_types.h"
 
-esz_status create_and_set_render_target(SDL_Texture** target, esz_window_t* window);
+esz_status bake_nearby_map_chunks(double time_limit, int32_t margin, esz_window_t* window, esz_core_t* core);
+esz_status create_and_set_render_target(SDL_Texture** target, esz_window_t* window, esz_core_t* core);
+void       destroy_map_chunks(esz_window_t* window, esz_core_t* core);
 esz_status draw_scene(esz_window_t* window, esz_core_t* core);
-esz_status render_actors(int32_t level, esz_window_t* window, esz_core_t* core);
+bool       is_scene_idle(esz_window_t* window, esz_core_t* core);
+esz_status patch_map_chunk(int32_t level, int32_t index_width, int32_t index_height, esz_window_t* window, esz_core_t* core);
+esz_status render_actors(esz_draw_layer_t* draw_layer, esz_window_t* window, esz_core_t* core);
 esz_status render_background(esz_window_t* window, esz_core_t* core);
 esz_status render_background_layer(int32_t index, esz_window_t* window, esz_core_t* core);
 esz_status render_map(int32_t level, esz_window_t* window, esz_core_t* core);
 esz_status render_scene(esz_window_t* window, esz_core_t* core);
+void       release_render_targets(esz_window_t* window, esz_core_t* core);
 
 #endif // ESZ_RENDER_H
@@ -0,0 +1,189 @@
+// SPDX-License-Identifier: MIT
+/**
+ * @file    esz_simulation.c
+ * @brief   eszFW simulation and scene snapshots
+ * @details The simulation publishes what the renderer needs into one
+ *          of three scene snapshots.  The simulation writes to its own
+ *          slot and swaps it with the ready slot; the renderer swaps
+ *          the ready slot with the one it reads from.  Neither side
+ *          ever waits for the other to finish a frame.
+ */
+
+#include <picolog.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <SDL.h>
+
+#include "esz_simulation.h"
+#include "esz_types.h"
+#include "esz_utils.h"
+
+void acquire_snapshot(esz_core_t* core)
+{
+    esz_map_t* map = core->map;
+
+    SDL_LockMutex(core->simulation.snapshot_lock);
+
+    if (map->is_snapshot_ready)
+    {
+        int32_t read_index = map->snapshot_read_index;
+
+        map->snapshot_read_index          = map->snapshot_ready_index;
+        map->snapshot_ready_index         = read_index;
+        map->is_snapshot_ready            = false;
+        map->render_layer_dirty          |= map->snapshot_render_layer_dirty;
+        map->snapshot_render_layer_dirty  = 0;
+    }
+
+    SDL_UnlockMutex(core->simulation.snapshot_lock);
+}
+
+esz_status create_snapshots(esz_core_t* core)
+{
+    esz_map_t* map = core->map;
+
+    for (int32_t index = 0; index < ESZ_SNAPSHOT_COUNT; index += 1)
+    {
+        esz_snapshot_t* snapshot = &map->snapshot[index];
+
+        if (0 < map->entity_count)
+        {
+            snapshot->entity = (esz_entity_snapshot_t*)calloc((size_t)map->entity_count, sizeof(struct esz_entity_snapshot));
+            if (! snapshot->entity)
+            {
+                plog_error("%s: error allocating memory.", __func__);
+                return ESZ_ERROR_CRITICAL;
+            }
+        }
+
+        if (0 < map->background.layer_count)
+        {
+            snapshot->background_pos_x = (double*)calloc((size_t)map->background.layer_count, sizeof(double));
+            if (! snapshot->background_pos_x)
+            {
+                plog_error("%s: error allocating memory.", __func__);
+                return ESZ_ERROR_CRITICAL;
+            }
+        }
+    }
+
+    map->snapshot_read_index  = 0;
+    map->snapshot_ready_index = 1;
+    map->snapshot_write_index = 2;
+
+    return ESZ_OK;
+}
+
+void destroy_snapshots(esz_core_t* core)
+{
+    for (int32_t index = 0; index < ESZ_SNAPSHOT_COUNT; index += 1)
+    {
+        free(core->map->snapshot[index].background_pos_x);
+        free(core->map->snapshot[index].entity);
+
+        core->map->snapshot[index].background_pos_x = NULL;
+        core->map->snapshot[index].entity           = NULL;
+    }
+}
+
+esz_snapshot_t* get_render_snapshot(esz_core_t* core)
+{
+    return &core->map->snapshot[core->map->snapshot_read_index];
+}
+
+void publish_snapshot(esz_core_t* core)
+{
+    esz_map_t*      map      = core->map;
+    esz_snapshot_t* snapshot = &map->snapshot[map->snapshot_write_index];
+    int32_t         write_index;
+
+    snapshot->camera_pos_x = core->camera.pos_x;
+    snapshot->camera_pos_y = core->camera.pos_y;
+
+    for (int32_t index = 0; index < map->background.layer_count; index += 1)
+    {
+        snapshot->background_pos_x[index] = map->background.layer[index].pos_x;
+    }
+
+    for (int32_t index = 0; index < map->entity_count; index += 1)
+    {
+        esz_entity_t*          entity          = &map->entity[index];
+        esz_entity_snapshot_t* entity_snapshot = &snapshot->entity[index];
+
+        entity_snapshot->bounding_box = entity->bounding_box;
+        entity_snapshot->pos_x        = entity->pos_x;
+        entity_snapshot->pos_y        = entity->pos_y;
+
+        if (entity->actor)
+        {
+            entity_snapshot->current_animation = entity->actor->current_animation;
+            entity_snapshot->current_frame     = entity->actor->current_frame;
+            entity_snapshot->state             = entity->actor->state;
+        }
+    }
+
+    SDL_LockMutex(core->simulation.snapshot_lock);
+
+    write_index                       = map->snapshot_write_index;
+    map->snapshot_write_index         = map->snapshot_ready_index;
+    map->snapshot_ready_index         = write_index;
+    map->is_snapshot_ready            = true;
+    map->snapshot_render_layer_dirty |= map->pending_render_layer_dirty;
+
+    SDL_UnlockMutex(core->simulation.snapshot_lock);
+
+    map->pending_render_layer_dirty = 0;
+}
+
+int run_simulation(void* data)
+{
+    esz_core_t*   core         = (esz_core_t*)data;
+    esz_window_t* window       = core->simulation.window;
+    double        frequency    = (double)SDL_GetPerformanceFrequency();
+    double        step_time    = 1.0 / (double)window->refresh_rate;
+    uint64_t      step_period  = (uint64_t)(frequency * step_time);
+    uint64_t      step_counter = SDL_GetPerformanceCounter();
+
+    plog_info("Start simulation thread.");
+
+    while (SDL_AtomicGet(&core->simulation.is_running))
+    {
+        uint64_t counter;
+
+        SDL_LockMutex(core->simulation.lock);
+
+        if (core->is_map_loaded)
+        {
+            update_simulation(step_time, window, core);
+        }
+
+        SDL_UnlockMutex(core->simulation.lock);
+
+        /* Steps are scheduled on a fixed grid.  If the simulation has
+         * fallen behind by more than a few steps, the grid is moved
+         * instead of catching up all at once.
+         */
+        counter       = SDL_GetPerformanceCounter();
+        step_counter += step_period;
+
+        if (step_counter + (step_period * ESZ_SIMULATION_STEP_MAX) < counter)
+        {
+            step_counter = counter;
+        }
+
+        wait_until(step_counter);
+    }
+
+    plog_info("Stop simulation thread.");
+
+    return 0;
+}
+
+void update_simulation(double delta_time, esz_window_t* window, esz_core_t* core)
+{
+    move_camera_to_target(core);
+    update_entities(delta_time, core);
+    update_background(delta_time, window, core);
+    publish_snapshot(core);
+}
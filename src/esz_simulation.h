@@ -0,0 +1,20 @@
+// SPDX-License-Identifier: MIT
+/**
+ * @file    esz_simulation.h
+ * @brief   eszFW simulation and scene snapshots
+ */
+
+#ifndef ESZ_SIMULATION_H
+#define ESZ_SIMULATION_H
+
+#include "esz_types.h"
+
+void            acquire_snapshot(esz_core_t* core);
+esz_status      create_snapshots(esz_core_t* core);
+void            destroy_snapshots(esz_core_t* core);
+esz_snapshot_t* get_render_snapshot(esz_core_t* core);
+void            publish_snapshot(esz_core_t* core);
+int             run_simulation(void* data);
+void            update_simulation(double delta_time, esz_window_t* window, esz_core_t* core);
+
+#endif // ESZ_SIMULATION_H
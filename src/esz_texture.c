@@ -0,0 +1,203 @@
+// SPDX-License-Identifier: MIT
+/**
+ * @file    esz_texture.c
+ * @brief   eszFW texture manager
+ * @details Every texture the engine creates goes through these
+ *          functions, so that the video memory in use can be estimated
+ *          and compared against the texture budget of the window.  The
+ *          estimate is the size of the pixel data; drivers may need
+ *          more than that.
+ *
+ *          The texture manager doesn't evict anything on its own:
+ *          caches that can be re-created, such as baked map chunks,
+ *          check the budget before they grow and give way in least
+ *          recently used order.
+ *
+ *          Render targets are pooled by size and format: released
+ *          targets are kept for reuse and only destroyed once the
+ *          target size has changed.
+ */
+
+#include <picolog.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <SDL.h>
+
+#include "esz_texture.h"
+#include "esz_types.h"
+
+esz_status acquire_render_target(SDL_Texture** target, uint32_t format, int32_t width, int32_t height, esz_window_t* window)
+{
+    esz_render_target_t* pool;
+
+    for (int32_t index = 0; index < window->render_target_count; index += 1)
+    {
+        esz_render_target_t* render_target = &window->render_target_pool[index];
+
+        if (render_target->is_in_use         ||
+            render_target->format != format ||
+            render_target->width  != width  ||
+            render_target->height != height)
+        {
+            continue;
+        }
+
+        render_target->is_in_use = true;
+        (*target)                = render_target->texture;
+
+        return ESZ_OK;
+    }
+
+    pool = (esz_render_target_t*)realloc(window->render_target_pool, (size_t)(window->render_target_count + 1) * sizeof(struct esz_render_target));
+    if (! pool)
+    {
+        plog_error("%s: error allocating memory.", __func__);
+        return ESZ_ERROR_CRITICAL;
+    }
+
+    window->render_target_pool = pool;
+
+    if (ESZ_OK != create_texture(target, format, SDL_TEXTUREACCESS_TARGET, width, height, window))
+    {
+        return ESZ_ERROR_CRITICAL;
+    }
+
+    pool[window->render_target_count].texture   = (*target);
+    pool[window->render_target_count].format    = format;
+    pool[window->render_target_count].height    = height;
+    pool[window->render_target_count].width     = width;
+    pool[window->render_target_count].is_in_use = true;
+
+    window->render_target_count += 1;
+
+    return ESZ_OK;
+}
+
+esz_status create_texture(SDL_Texture** texture, uint32_t format, int32_t access, int32_t width, int32_t height, esz_window_t* window)
+{
+    (*texture) = SDL_CreateTexture(window->renderer, format, access, width, height);
+
+    if (! (*texture))
+    {
+        plog_error("%s: %s.", __func__, SDL_GetError());
+        return ESZ_ERROR_CRITICAL;
+    }
+
+    window->texture_memory_usage += get_texture_size((*texture));
+    window->texture_count        += 1;
+
+    return ESZ_OK;
+}
+
+esz_status create_texture_from_surface(SDL_Texture** texture, SDL_Surface* surface, esz_window_t* window)
+{
+    (*texture) = SDL_CreateTextureFromSurface(window->renderer, surface);
+
+    if (! (*texture))
+    {
+        plog_error("%s: %s.", __func__, SDL_GetError());
+        return ESZ_ERROR_CRITICAL;
+    }
+
+    window->texture_memory_usage += get_texture_size((*texture));
+    window->texture_count        += 1;
+
+    return ESZ_OK;
+}
+
+void destroy_render_target_pool(esz_window_t* window)
+{
+    for (int32_t index = 0; index < window->render_target_count; index += 1)
+    {
+        destroy_texture(&window->render_target_pool[index].texture, window);
+    }
+
+    free(window->render_target_pool);
+
+    window->render_target_pool  = NULL;
+    window->render_target_count = 0;
+}
+
+void destroy_texture(SDL_Texture** texture, esz_window_t* window)
+{
+    if (*texture)
+    {
+        size_t size = get_texture_size((*texture));
+
+        SDL_DestroyTexture((*texture));
+        (*texture) = NULL;
+
+        window->texture_memory_usage -= SDL_min(size, window->texture_memory_usage);
+        window->texture_count        -= 1;
+    }
+}
+
+size_t get_texture_size(SDL_Texture* texture)
+{
+    uint32_t format;
+    int      width;
+    int      height;
+
+    if (0 > SDL_QueryTexture(texture, &format, NULL, &width, &height))
+    {
+        return 0;
+    }
+
+    // Formats without a fixed pixel size (e.g. YUV) are estimated at 4 bytes.
+    if (SDL_ISPIXELFORMAT_FOURCC(format))
+    {
+        return (size_t)width * (size_t)height * 4;
+    }
+
+    return (size_t)width * (size_t)height * (size_t)SDL_BYTESPERPIXEL(format);
+}
+
+bool is_texture_budget_exceeded(size_t size, esz_window_t* window)
+{
+    return window->texture_memory_usage + size > window->texture_memory_budget;
+}
+
+void release_render_target(SDL_Texture** target, esz_window_t* window)
+{
+    if (! (*target))
+    {
+        return;
+    }
+
+    for (int32_t index = 0; index < window->render_target_count; index += 1)
+    {
+        if (window->render_target_pool[index].texture == (*target))
+        {
+            window->render_target_pool[index].is_in_use = false;
+            (*target)                                   = NULL;
+            return;
+        }
+    }
+
+    // Not from the pool; nothing to keep it for.
+    destroy_texture(target, window);
+}
+
+void trim_render_target_pool(int32_t width, int32_t height, esz_window_t* window)
+{
+    int32_t count = 0;
+
+    // Unused targets of any other size won't be asked for again.
+    for (int32_t index = 0; index < window->render_target_count; index += 1)
+    {
+        esz_render_target_t* render_target = &window->render_target_pool[index];
+
+        if (! render_target->is_in_use && (render_target->width != width || render_target->height != height))
+        {
+            destroy_texture(&render_target->texture, window);
+            continue;
+        }
+
+        window->render_target_pool[count]  = *render_target;
+        count                             += 1;
+    }
+
+    window->render_target_count = count;
+}
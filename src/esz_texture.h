@@ -0,0 +1,27 @@
+// SPDX-License-Identifier: MIT
+/**
+ * @file    esz_texture.h
+ * @brief   eszFW texture manager
+ */
+
+#ifndef ESZ_TEXTURE_H
+#define ESZ_TEXTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <SDL.h>
+
+#include "esz_types.h"
+
+esz_status acquire_render_target(SDL_Texture** target, uint32_t format, int32_t width, int32_t height, esz_window_t* window);
+esz_status create_texture(SDL_Texture** texture, uint32_t format, int32_t access, int32_t width, int32_t height, esz_window_t* window);
+esz_status create_texture_from_surface(SDL_Texture** texture, SDL_Surface* surface, esz_window_t* window);
+void       destroy_render_target_pool(esz_window_t* window);
+void       destroy_texture(SDL_Texture** texture, esz_window_t* window);
+size_t     get_texture_size(SDL_Texture* texture);
+bool       is_texture_budget_exceeded(size_t size, esz_window_t* window);
+void       release_render_target(SDL_Texture** target, esz_window_t* window);
+void       trim_render_target_pool(int32_t width, int32_t height, esz_window_t* window);
+
+#endif // ESZ_TEXTURE_H
@@ -47,6 +47,112 @@ typedef struct cute_tiled_tileset_t         esz_tiled_tileset_t;
 
 #endif
 
+/**
+ * @brief Edge length of a map chunk in pixels
+ */
+#define ESZ_MAP_CHUNK_SIZE 512
+
+/**
+ * @brief Default video memory budget for baked map chunks in bytes
+ */
+#define ESZ_MAP_CHUNK_BUDGET (64 * 1024 * 1024)
+
+/**
+ * @brief Default video memory budget for all textures in bytes
+ */
+#define ESZ_TEXTURE_BUDGET (256 * 1024 * 1024)
+
+/**
+ * @brief Default time per frame for baking map chunks ahead of time in
+ *        seconds
+ */
+#define ESZ_MAP_CHUNK_BAKE_TIME 0.002
+
+/**
+ * @brief Number of chunks around the viewport that are baked ahead of
+ *        time
+ */
+#define ESZ_MAP_CHUNK_BAKE_MARGIN 1
+
+/**
+ * @brief Number of downsampled copies kept of each baked map chunk
+ *        layer when zoomed out; each one has half the size of the
+ *        previous one
+ */
+#define ESZ_MAP_CHUNK_MIP_MAX 3
+
+/**
+ * @brief Default edge length of a texture atlas page in pixels
+ */
+#define ESZ_ATLAS_PAGE_SIZE 4096
+
+/**
+ * @brief Spacing between two images on a texture atlas page in pixels
+ */
+#define ESZ_ATLAS_PADDING 1
+
+/**
+ * @brief The number of scene snapshots shared by the simulation and
+ *        the renderer (triple buffering).
+ */
+#define ESZ_SNAPSHOT_COUNT 3
+
+/**
+ * @brief Lowest render scale of the dynamic resolution
+ */
+#define ESZ_RENDER_SCALE_MIN 0.5
+
+/**
+ * @brief Step by which the dynamic resolution is changed
+ */
+#define ESZ_RENDER_SCALE_STEP 0.125
+
+/**
+ * @brief Number of frames the dynamic resolution is averaged over
+ */
+#define ESZ_RENDER_SCALE_SAMPLES 30
+
+/**
+ * @brief Number of cells per axis of the grid on which the render
+ *        queue looks for overlapping draw commands
+ */
+#define ESZ_RENDER_QUEUE_GRID 16
+
+/**
+ * @brief Granularity in pixels to which the size of the render targets
+ *        is rounded up
+ */
+#define ESZ_RENDER_TARGET_BUCKET 64
+
+/**
+ * @brief Longest frame time in seconds that is passed on to the
+ *        simulation; longer pauses are clamped to it
+ */
+#define ESZ_FRAME_TIME_MAX 0.25
+
+/**
+ * @brief Deviation from the refresh period in seconds below which a
+ *        measured frame time is snapped to the refresh period
+ */
+#define ESZ_FRAME_TIME_SNAP 0.0002
+
+/**
+ * @brief Time in seconds before a frame deadline that is spent spinning
+ *        instead of sleeping
+ */
+#define ESZ_FRAME_SPIN_TIME 0.002
+
+/**
+ * @brief Highest number of fixed simulation steps per frame
+ */
+#define ESZ_SIMULATION_STEP_MAX 8
+
+/**
+ * @brief Update rate in Hz while the window is unfocused or minimised
+ *        and the low-power mode is enabled
+ */
+#define ESZ_LOW_POWER_RATE 10
+
 typedef struct esz_window esz_window_t;
 typedef struct esz_core   esz_core_t;
 
@@ -87,16 +193,14 @@ typedef enum
 } esz_direction;
 
 /**
- * @brief An enumeration of actor layer levels.
+ * @brief An enumeration of draw layer types.
  */
 typedef enum
 {
-    ESZ_ACTOR_LAYER_BG = 0,
-    ESZ_ACTOR_LAYER_MG,
-    ESZ_ACTOR_LAYER_FG,
-    ESZ_ACTOR_LAYER_LEVEL_MAX
+    ESZ_DRAW_ACTORS = 0,
+    ESZ_DRAW_MAP_LEVEL
 
-} esz_actor_layer_level;
+} esz_draw_layer_type;
 
 /**
  * @brief An enumeration of event types
@@ -114,17 +218,6 @@ typedef enum
 
 } esz_event_type;
 
-/**
- * @brief An enumeration of map layer levels.
- */
-typedef enum
-{
-    ESZ_MAP_LAYER_BG = 0,
-    ESZ_MAP_LAYER_FG,
-    ESZ_MAP_LAYER_LEVEL_MAX
-
-} esz_map_layer_level;
-
 /**
  * @brief An enumeration of render layer levels.
  */
@@ -197,6 +290,17 @@ typedef enum
 
 } esz_tile_property;
 
+/**
+ * @brief An enumeration of tile opacities.
+ */
+typedef enum
+{
+    TILE_EMPTY = 0,
+    TILE_OPAQUE,
+    TILE_TRANSLUCENT
+
+} esz_tile_opacity;
+
 /**
  * @brief A structure that contains a axis-aligned bounding box.
  */
@@ -216,13 +320,68 @@ typedef struct esz_animated_tile
 {
     int32_t dst_x;
     int32_t dst_y;
-    int32_t animation_length;
+    int32_t animation;
     int32_t current_frame;
-    int32_t gid;
-    int32_t id;
 
 } esz_animated_tile_t;
 
+/**
+ * @brief   A structure that contains the animated tiles of a map chunk
+ *          on one map level.
+ * @details The tiles are stored from animated_tile[tile_offset] up to,
+ *          but not including, animated_tile[tile_offset + tile_count]
+ *          and are drawn to a transparent texture on top of the chunk.
+ */
+typedef struct esz_tile_overlay
+{
+    SDL_Texture* texture;
+    uint32_t     tick;
+    int32_t      tile_count;
+    int32_t      tile_offset;
+
+} esz_tile_overlay_t;
+
+/**
+ * @brief A structure that contains the timeline of an animated tile.
+ * @note  All instances of the same animated tile share one timeline.
+ *        Each frame is stored as a gid and drawn from its tile source.
+ */
+typedef struct esz_tile_animation
+{
+    int32_t* frame;
+    int32_t  current_frame;
+    int32_t  frame_count;
+    int32_t  id;
+
+} esz_tile_animation_t;
+
+/**
+ * @brief   A structure that contains the source of a tile.
+ * @details The tile sources of a map are stored in a table indexed by
+ *          gid that covers every tileset.  The texture and rectangle
+ *          point into the texture atlas once it has been built.
+ */
+typedef struct esz_tile_source
+{
+    SDL_Rect     src;
+    SDL_Texture* texture;
+    int32_t      tileset_index;
+    uint8_t      opacity;
+
+} esz_tile_source_t;
+
+/**
+ * @brief A structure that contains a tileset.
+ */
+typedef struct esz_tileset
+{
+    SDL_Texture* texture;
+    int32_t      first_gid;
+    int32_t      offset_x;
+    int32_t      offset_y;
+
+} esz_tileset_t;
+
 /**
  * @brief A structure that contains animation settings.
  */
@@ -235,6 +394,46 @@ typedef struct esz_animation
 
 } esz_animation_t;
 
+/**
+ * @brief A structure that contains an image queued for a texture atlas.
+ * @note  The texture and offset pointers are written once the atlas
+ *        has been built.
+ */
+typedef struct esz_atlas_image
+{
+    SDL_Surface*  surface;
+    SDL_Texture** texture;
+    int32_t*      offset_x;
+    int32_t*      offset_y;
+    int32_t       page;
+    int32_t       pos_x;
+    int32_t       pos_y;
+
+} esz_atlas_image_t;
+
+/**
+ * @brief A structure that contains a segment of a skyline.
+ */
+typedef struct esz_atlas_node
+{
+    int32_t pos_x;
+    int32_t pos_y;
+    int32_t width;
+
+} esz_atlas_node_t;
+
+/**
+ * @brief A structure that contains a texture atlas.
+ */
+typedef struct esz_atlas
+{
+    SDL_Texture**      page;
+    esz_atlas_image_t* image;
+    int32_t            image_count;
+    int32_t            page_count;
+
+} esz_atlas_t;
+
 /**
  * @brief A structure that contains a background layer.
  */
@@ -271,6 +470,8 @@ typedef struct esz_camera
 {
     double  pos_x;
     double  pos_y;
+    int32_t logical_height;
+    int32_t logical_width;
     int32_t max_pos_x;
     int32_t max_pos_y;
     int32_t target_actor_id;
@@ -280,7 +481,23 @@ typedef struct esz_camera
 } esz_camera_t;
 
 /**
- * @brief A structure that contains the initial window configuration.
+ * @brief  A structure that contains the initial window configuration.
+ * @remark If enable_direct_composition is set, all layers are drawn
+ *         straight to the window instead of being composed from one
+ *         render target per layer.  The scene is always rendered at
+ *         the logical size and scaled to the window size once; set
+ *         enable_integer_scaling and enable_nearest_neighbour to keep
+ *         pixel art crisp.  If enable_headless_mode is set, the scene
+ *         is rendered offscreen by the software renderer of SDL's dummy
+ *         video driver, without VSync or frame delay; useful for
+ *         measuring frame times on machines without a display.  If
+ *         enable_dynamic_resolution is set, the render targets are
+ *         scaled down while frames take longer than the refresh
+ *         interval and scaled up again once there is headroom.  If
+ *         enable_low_power_mode is set, frames in which nothing
+ *         visible has changed are neither rendered nor presented, and
+ *         the update rate is lowered while the window is unfocused or
+ *         minimised.
  */
 typedef struct esz_window_config
 {
@@ -290,6 +507,12 @@ typedef struct esz_window_config
     const int32_t logical_height;
     const bool    enable_fullscreen;
     const bool    enable_vsync;
+    const bool    enable_direct_composition;
+    const bool    enable_integer_scaling;
+    const bool    enable_nearest_neighbour;
+    const bool    enable_headless_mode;
+    const bool    enable_dynamic_resolution;
+    const bool    enable_low_power_mode;
 
 } esz_window_config_t;
 
@@ -349,10 +572,98 @@ typedef struct esz_entity
     int32_t             height;
     int32_t             id;
     int32_t             index;
+    int32_t             layer_index;
     int32_t             width;
 
 } esz_entity_t;
 
+/**
+ * @brief   A structure that contains an entry of the draw order.
+ * @details The draw order is built once when the map is loaded and
+ *          follows the order in which the render layers are composed.
+ *          Actors are drawn from the entity indices
+ *          draw_entity[entity_offset] up to, but not including,
+ *          draw_entity[entity_offset + entity_count].  They are either
+ *          the actors of the object group at layer_index or, if it is
+ *          -1, the actors whose state selects the render layer.
+ */
+typedef struct esz_draw_layer
+{
+    esz_draw_layer_type type;
+    esz_render_layer    render_layer;
+    int32_t             entity_count;
+    int32_t             entity_offset;
+    int32_t             layer_index;
+    int32_t             level;
+
+} esz_draw_layer_t;
+
+/**
+ * @brief   A structure that contains a map chunk.
+ * @details The map is split into a grid of chunks which are baked on
+ *          demand and evicted again when they are no longer needed.
+ *          There is one layer texture and one animated tile overlay
+ *          per map level.
+ *          mip_texture[(level * ESZ_MAP_CHUNK_MIP_MAX) + n] holds the
+ *          level scaled down by a factor of 2^(n + 1); it is created
+ *          once the camera is zoomed out far enough to need it.
+ */
+typedef struct esz_map_chunk
+{
+    SDL_Texture**       layer_texture;
+    SDL_Texture**       mip_texture;
+    esz_tile_overlay_t* animated_tile_overlay;
+    uint32_t            last_render_frame;
+    int32_t             height;
+    int32_t             pos_x;
+    int32_t             pos_y;
+    int32_t             width;
+
+} esz_map_chunk_t;
+
+/**
+ * @brief A structure that contains the render state of an entity.
+ */
+typedef struct esz_entity_snapshot
+{
+    struct esz_aabb bounding_box;
+    double          pos_x;
+    double          pos_y;
+    int32_t         current_animation;
+    int32_t         current_frame;
+    uint32_t        state;
+
+} esz_entity_snapshot_t;
+
+/**
+ * @brief   A structure that contains a scene snapshot.
+ * @details An immutable copy of everything the renderer reads that the
+ *          simulation writes.  Snapshots are published by the simulation
+ *          and consumed by the renderer.
+ */
+typedef struct esz_snapshot
+{
+    double*                background_pos_x;
+    double                 camera_pos_x;
+    double                 camera_pos_y;
+    esz_entity_snapshot_t* entity;
+
+} esz_snapshot_t;
+
+/**
+ * @brief   A structure that contains the occupied cells of a tile layer.
+ * @details The cells are grouped by map chunk: the cells of chunk n are
+ *          stored from cell[chunk_offset[n]] up to, but not including,
+ *          cell[chunk_offset[n + 1]].  Each cell is a tile index.
+ */
+typedef struct esz_tile_layer_index
+{
+    int32_t* cell;
+    int32_t* chunk_offset;
+    int32_t  cell_count;
+
+} esz_tile_layer_index_t;
+
 /**
  * @brief A structure that contains a sprite.
  */
@@ -360,6 +671,8 @@ typedef struct esz_sprite
 {
     SDL_Texture* texture;
     int32_t      id;
+    int32_t      offset_x;
+    int32_t      offset_y;
 
 } esz_sprite_t;
 
@@ -368,83 +681,261 @@ typedef struct esz_sprite
  */
 typedef struct esz_map
 {
-    double                decimal_property;
-    double                gravitation;
-    double                pos_x;
-    double                pos_y;
-    double                time_since_last_anim_frame;
+    double                  decimal_property;
+    double                  gravitation;
+    double                  last_camera_pos_x;
+    double                  last_camera_pos_y;
+    double                  last_zoom_level;
+    double                  pos_x;
+    double                  pos_y;
+    double                  time_since_last_anim_frame;
 
     #ifdef USE_LIBTMX
-    uint64_t              hash_query;
+    uint64_t                hash_query;
     #else
-    long long unsigned    hash_id_objectgroup;
-    long long unsigned    hash_id_tilelayer;
+    long long unsigned      hash_id_objectgroup;
+    long long unsigned      hash_id_tilelayer;
     #endif
 
-    size_t                path_length;
-    const char*           string_property;
-    char*                 path;
-    SDL_Texture*          animated_tile_texture;
-    SDL_Texture*          layer_texture[ESZ_MAP_LAYER_LEVEL_MAX];
-    SDL_Texture*          render_target[ESZ_RENDER_LAYER_MAX];
-    SDL_Texture*          tileset_texture;
-    esz_animated_tile_t*  animated_tile;
-    struct esz_background background;
-    esz_entity_t*         entity;
-    esz_sprite_t*         sprite;
-    esz_tiled_map_t*      handle;
-    uint32_t*             tile_properties;
-    int32_t               active_player_actor_id;
-    int32_t               animated_tile_fps;
-    int32_t               animated_tile_index;
-    int32_t               height;
-    int32_t               integer_property;
-    int32_t               meter_in_pixel;
-    int32_t               entity_count;
-    int32_t               sprite_sheet_count;
-    int32_t               width;
-    bool                  boolean_property;
+    size_t                  chunk_memory_usage;
+    size_t                  path_length;
+    const char*             string_property;
+    char*                   path;
+    SDL_Texture*            render_target[ESZ_RENDER_LAYER_MAX];
+    SDL_Texture**           chunk_layer_texture;
+    SDL_Texture**           chunk_mip_texture;
+    esz_animated_tile_t*    animated_tile;
+    struct esz_atlas        atlas;
+    struct esz_background   background;
+    struct esz_snapshot     snapshot[ESZ_SNAPSHOT_COUNT];
+    esz_draw_layer_t*       draw_layer;
+    esz_entity_t*           entity;
+    esz_map_chunk_t*        chunk;
+    esz_render_layer*       level_render_layer;
+    esz_sprite_t*           sprite;
+    esz_tile_animation_t*   tile_animation;
+    esz_tile_layer_index_t* tile_layer_index;
+    esz_tile_overlay_t*     chunk_animated_tile_overlay;
+    esz_tile_source_t*      tile_source;
+    esz_tiled_map_t*        handle;
+    esz_tileset_t*          tileset;
+    int32_t*                draw_entity;
+    int32_t*                tile_layer_level;
+    uint32_t*               tile_properties;
+    uint32_t                animated_render_layers;
+    uint32_t                animated_tile_tick;
+    uint32_t                pending_render_layer_dirty;
+    uint32_t                render_frame;
+    uint32_t                render_layer_dirty;
+    uint32_t                snapshot_render_layer_dirty;
+    int32_t                 active_player_actor_id;
+    int32_t                 animated_tile_fps;
+    int32_t                 animated_tile_index;
+    int32_t                 chunk_count_x;
+    int32_t                 chunk_count_y;
+    int32_t                 draw_layer_count;
+    int32_t                 height;
+    int32_t                 integer_property;
+    int32_t                 layer_count;
+    int32_t                 level_count;
+    int32_t                 meter_in_pixel;
+    int32_t                 entity_count;
+    int32_t                 render_target_height;
+    int32_t                 render_target_width;
+    int32_t                 snapshot_read_index;
+    int32_t                 snapshot_ready_index;
+    int32_t                 snapshot_write_index;
+    int32_t                 sprite_sheet_count;
+    int32_t                 tile_animation_count;
+    int32_t                 tile_source_count;
+    int32_t                 tileset_count;
+    int32_t                 width;
+    bool                    boolean_property;
+    bool                    is_snapshot_ready;
 
 } esz_map_t;
 
+/**
+ * @brief A structure that contains per-frame render statistics.
+ */
+typedef struct esz_render_stats
+{
+    int32_t actors_culled;
+    int32_t actors_drawn;
+    int32_t commands_submitted;
+    int32_t texture_switches;
+
+} esz_render_stats_t;
+
+/**
+ * @brief   A structure that contains the simulation thread.
+ * @details The lock serialises the simulation with the event handling
+ *          and map loading of the main thread; the snapshot lock only
+ *          guards the exchange of scene snapshots.
+ */
+typedef struct esz_simulation
+{
+    SDL_atomic_t  is_running;
+    SDL_mutex*    lock;
+    SDL_mutex*    snapshot_lock;
+    SDL_Thread*   thread;
+    esz_window_t* window;
+
+} esz_simulation_t;
+
 /**
  * @brief A structure that contains an engine core.
  */
 typedef struct esz_core
 {
-    struct esz_camera camera;
-    struct esz_event  event;
-    esz_map_t*        map;
-    uint32_t          debug;
-    bool              is_active;
-    bool              is_map_loaded;
-    bool              is_paused;
+    struct esz_camera       camera;
+    struct esz_event        event;
+    struct esz_render_stats render_stats;
+    struct esz_simulation   simulation;
+    esz_map_t*              map;
+    double                  chunk_bake_time;
+    size_t                  chunk_memory_budget;
+    uint32_t                debug;
+    bool                    is_active;
+    bool                    is_map_loaded;
+    bool                    is_paused;
 
 } esz_core_t;
 
+/**
+ * @brief A structure that contains a single quad of a sprite batch.
+ */
+typedef struct esz_batch_quad
+{
+    SDL_Rect         dst;
+    SDL_Rect         src;
+    SDL_RendererFlip flip;
+
+} esz_batch_quad_t;
+
+/**
+ * @brief A structure that contains a sprite batch.
+ * @note  All quads of a batch share the same texture and are
+ *        submitted with a single draw call on flush.
+ */
+typedef struct esz_batch
+{
+    SDL_Texture*      texture;
+    esz_batch_quad_t* quad;
+    #if SDL_VERSION_ATLEAST(2, 0, 18)
+    SDL_Vertex*       vertex;
+    int*              index;
+    #endif
+    int32_t           quad_capacity;
+    int32_t           quad_count;
+    bool              is_geometry_unsupported;
+
+} esz_batch_t;
+
+/**
+ * @brief A structure that contains a queued draw command.
+ */
+typedef struct esz_render_command
+{
+    SDL_Rect         dst;
+    SDL_Rect         src;
+    SDL_RendererFlip flip;
+    SDL_Texture*     texture;
+    esz_render_layer layer;
+    int32_t          order;
+    int32_t          sort_key;
+
+} esz_render_command_t;
+
+/**
+ * @brief A structure that contains the latest run of a texture in the
+ *        render queue.
+ */
+typedef struct esz_texture_run
+{
+    SDL_Texture* texture;
+    int32_t      run;
+
+} esz_texture_run_t;
+
+/**
+ * @brief   A structure that contains the render queue of a frame.
+ * @details Draw commands are collected while the scene is walked and
+ *          submitted once per frame, sorted by layer and texture.  The
+ *          layer mask holds the layers that are redrawn this frame.
+ */
+typedef struct esz_render_queue
+{
+    esz_render_command_t* command;
+    esz_texture_run_t*    texture_run;
+    uint32_t              layer_mask;
+    int32_t               cell_run[ESZ_RENDER_QUEUE_GRID * ESZ_RENDER_QUEUE_GRID];
+    int32_t               command_capacity;
+    int32_t               command_count;
+    int32_t               texture_run_capacity;
+
+} esz_render_queue_t;
+
+/**
+ * @brief   A structure that contains a pooled render target.
+ * @details Render targets are kept by the window and handed out again
+ *          to whoever asks for the same size and format, e.g. the
+ *          next map that is loaded.
+ */
+typedef struct esz_render_target
+{
+    SDL_Texture* texture;
+    uint32_t     format;
+    int32_t      height;
+    int32_t      width;
+    bool         is_in_use;
+
+} esz_render_target_t;
+
 /**
  * @brief A structure that contains a window and the rendering context.
  */
 typedef struct esz_window
 {
-    double        initial_zoom_level;
-    double        time_since_last_frame;
-    double        zoom_level;
-    SDL_Renderer* renderer;
-    SDL_Texture*  esz_logo;
-    SDL_Window*   window;
-    uint32_t      flags;
-    uint32_t      time_a;
-    uint32_t      time_b;
-    int32_t       height;
-    int32_t       logical_height;
-    int32_t       logical_width;
-    int32_t       pos_x;
-    int32_t       pos_y;
-    int32_t       refresh_rate;
-    int32_t       width;
-    bool          is_fullscreen;
-    bool          vsync_enabled;
+    struct esz_batch        batch;
+    struct esz_render_queue queue;
+    esz_render_target_t*    render_target_pool;
+    double                  frame_time_sum;
+    double                  initial_zoom_level;
+    double                  render_scale;
+    double                  render_time_sum;
+    double                  time_accumulator;
+    double                  time_since_last_frame;
+    double                  zoom_level;
+    size_t                  texture_memory_budget;
+    size_t                  texture_memory_usage;
+    SDL_Renderer*           renderer;
+    SDL_Texture*            esz_logo;
+    SDL_Window*             window;
+    uint64_t                frame_deadline;
+    uint64_t                last_frame_counter;
+    uint64_t                last_update_counter;
+    uint32_t                flags;
+    int32_t                 frame_sample_count;
+    int32_t                 height;
+    int32_t                 logical_height;
+    int32_t                 logical_width;
+    int32_t                 pos_x;
+    int32_t                 pos_y;
+    int32_t                 refresh_rate;
+    int32_t                 render_target_count;
+    int32_t                 texture_count;
+    int32_t                 width;
+    bool                    direct_composition_enabled;
+    bool                    dynamic_resolution_enabled;
+    bool                    has_focus;
+    bool                    is_frame_skipped;
+    bool                    is_fullscreen;
+    bool                    is_headless;
+    bool                    is_minimised;
+    bool                    is_redraw_required;
+    bool                    low_power_enabled;
+    bool                    vsync_enabled;
 
 } esz_window_t;
 
@@ -5,6 +5,7 @@
  */
 
 #include <math.h>
+#include <picolog.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <SDL.h>
@@ -13,9 +14,50 @@
 #include "esz_compat.h"
 #include "esz_hash.h"
 #include "esz_macros.h"
+#include "esz_render.h"
 #include "esz_types.h"
 #include "esz_utils.h"
 
+esz_status add_tile_to_layer_index(int32_t layer_position, int32_t index_width, int32_t index_height, esz_core_t* core)
+{
+    esz_tile_layer_index_t* tile_layer_index = &core->map->tile_layer_index[layer_position];
+    int32_t*                cell;
+    int32_t                 chunk_count      = core->map->chunk_count_x * core->map->chunk_count_y;
+    int32_t                 chunk_index      = get_tile_chunk_index(index_width, index_height, core);
+    int32_t                 tile_index       = (index_height * (int32_t)core->map->handle->width) + index_width;
+    int32_t                 insert_index;
+
+    for (int32_t index = tile_layer_index->chunk_offset[chunk_index]; index < tile_layer_index->chunk_offset[chunk_index + 1]; index += 1)
+    {
+        if (tile_index == tile_layer_index->cell[index])
+        {
+            return ESZ_OK;
+        }
+    }
+
+    cell = (int32_t*)realloc(tile_layer_index->cell, (size_t)(tile_layer_index->cell_count + 1) * sizeof(int32_t));
+    if (! cell)
+    {
+        plog_error("%s: error allocating memory.", __func__);
+        return ESZ_ERROR_CRITICAL;
+    }
+
+    // Appended to the end of its chunk; the order within a chunk is not significant.
+    insert_index = tile_layer_index->chunk_offset[chunk_index + 1];
+    SDL_memmove(&cell[insert_index + 1], &cell[insert_index], (size_t)(tile_layer_index->cell_count - insert_index) * sizeof(int32_t));
+
+    cell[insert_index]            = tile_index;
+    tile_layer_index->cell        = cell;
+    tile_layer_index->cell_count += 1;
+
+    for (int32_t index = chunk_index + 1; index <= chunk_count; index += 1)
+    {
+        tile_layer_index->chunk_offset[index] += 1;
+    }
+
+    return ESZ_OK;
+}
+
 bool get_boolean_property(const uint64_t name_hash, esz_tiled_property_t* properties, int32_t property_count, esz_core_t* core)
 {
     core->map->boolean_property = false;
@@ -37,6 +79,48 @@ int32_t get_integer_property(const uint64_t name_hash, esz_tiled_property_t* pro
     return core->map->integer_property;
 }
 
+esz_map_chunk_t* get_map_chunk(int32_t pos_x, int32_t pos_y, esz_core_t* core)
+{
+    int32_t index_width  = pos_x / ESZ_MAP_CHUNK_SIZE;
+    int32_t index_height = pos_y / ESZ_MAP_CHUNK_SIZE;
+
+    return &core->map->chunk[(index_height * core->map->chunk_count_x) + index_width];
+}
+
+int32_t get_mip_level(esz_window_t* window)
+{
+    double  scale     = window->render_scale * SDL_min(window->zoom_level, 1.0);
+    int32_t mip_level = 0;
+
+    /* Zoomed out, the chunks end up smaller on screen than they are
+     * baked.  Pick the smallest copy that still has at least the
+     * resolution they are displayed at; the render targets are not
+     * affected by this.
+     */
+    while (mip_level < ESZ_MAP_CHUNK_MIP_MAX && 0.5 >= scale)
+    {
+        scale     *= 2.0;
+        mip_level += 1;
+    }
+
+    return mip_level;
+}
+
+int32_t get_render_target_bucket(int32_t size)
+{
+    // A quarter of headroom, rounded up to the next bucket.
+    size += size / 4;
+
+    return ((size + ESZ_RENDER_TARGET_BUCKET - 1) / ESZ_RENDER_TARGET_BUCKET) * ESZ_RENDER_TARGET_BUCKET;
+}
+
+void get_render_target_size(int32_t* width, int32_t* height, esz_window_t* window)
+{
+    // The scene is drawn in logical coordinates.
+    *width  = (int32_t)ceil((double)window->logical_width  * window->render_scale);
+    *height = (int32_t)ceil((double)window->logical_height * window->render_scale);
+}
+
 const char* get_string_property(const uint64_t name_hash, esz_tiled_property_t* properties, int32_t property_count, esz_core_t* core)
 {
     core->map->string_property = NULL;
@@ -44,12 +128,79 @@ const char* get_string_property(const uint64_t name_hash, esz_tiled_property_t*
     return core->map->string_property;
 }
 
+int32_t get_tile_chunk_index(int32_t index_width, int32_t index_height, esz_core_t* core)
+{
+    int32_t index_chunk_width  = (index_width  * get_tile_width(core->map->handle))  / ESZ_MAP_CHUNK_SIZE;
+    int32_t index_chunk_height = (index_height * get_tile_height(core->map->handle)) / ESZ_MAP_CHUNK_SIZE;
+
+    return (index_chunk_height * core->map->chunk_count_x) + index_chunk_width;
+}
+
+esz_tile_opacity get_tile_opacity(int32_t gid, esz_core_t* core)
+{
+    // Gids outside of the table don't belong to any tileset.
+    if (0 >= gid || gid >= core->map->tile_source_count)
+    {
+        return TILE_EMPTY;
+    }
+
+    return (esz_tile_opacity)core->map->tile_source[gid].opacity;
+}
+
+bool is_actor_layer_state(esz_state state)
+{
+    // These states select the draw order entries an actor is drawn by.
+    switch (state)
+    {
+        case STATE_IN_BACKGROUND:
+        case STATE_IN_FOREGROUND:
+        case STATE_IN_MIDGROUND:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool is_actor_in_draw_layer(esz_entity_t* entity, esz_draw_layer_t* draw_layer)
+{
+    esz_actor_t* actor = entity->actor;
+    esz_state    state = STATE_IN_FOREGROUND;
+
+    if (! actor || ESZ_DRAW_ACTORS != draw_layer->type)
+    {
+        return false;
+    }
+
+    // Actors in the background leave their object group behind.
+    if (0 <= draw_layer->layer_index)
+    {
+        return draw_layer->layer_index == entity->layer_index && ! IS_STATE_SET(actor->state, STATE_IN_BACKGROUND);
+    }
+
+    if (ESZ_ACTOR_BG == draw_layer->render_layer)
+    {
+        state = STATE_IN_BACKGROUND;
+    }
+    else if (ESZ_ACTOR_MG == draw_layer->render_layer)
+    {
+        state = STATE_IN_MIDGROUND;
+    }
+
+    return IS_STATE_SET(actor->state, state);
+}
+
 bool is_camera_at_horizontal_boundary(esz_core_t* core)
 {
     return core->camera.is_at_horizontal_boundary;
 }
 
-void move_camera_to_target(esz_window_t* window, esz_core_t* core)
+bool is_tile_layer_animated(int32_t layer_index, esz_core_t* core)
+{
+    // Animated tiles are laid out on every map level.
+    return 0 <= core->map->tile_layer_level[layer_index];
+}
+
+void move_camera_to_target(esz_core_t* core)
 {
     if (core->camera.is_locked)
     {
@@ -60,9 +211,9 @@ void move_camera_to_target(esz_window_t* window, esz_core_t* core)
                 esz_entity_t* target = &core->map->entity[core->camera.target_actor_id];
 
                 core->camera.pos_x = target->pos_x;
-                core->camera.pos_x -= (double)window->logical_width / 2.0;
+                core->camera.pos_x -= (double)core->camera.logical_width / 2.0;
                 core->camera.pos_y = target->pos_y;
-                core->camera.pos_y -= (double)window->logical_height / 2.0;
+                core->camera.pos_y -= (double)core->camera.logical_height / 2.0;
             }
 
             if (0 > core->camera.pos_x)
@@ -70,7 +221,7 @@ void move_camera_to_target(esz_window_t* window, esz_core_t* core)
                 core->camera.pos_x = 0;
             }
 
-            set_camera_boundaries_to_map_size(window, core);
+            set_camera_boundaries_to_map_size(core);
         }
     }
 }
@@ -138,6 +289,59 @@ void poll_events(esz_window_t* window, esz_core_t* core)
                     core->event.multi_gesture_cb(window, core);
                 }
                 break;
+            case SDL_RENDER_TARGETS_RESET:
+                // The contents of all render targets have been lost.
+                if (core->is_map_loaded)
+                {
+                    destroy_map_chunks(window, core);
+                    release_render_targets(window, core);
+                }
+                break;
+            case SDL_WINDOWEVENT:
+                switch (core->event.handle.window.event)
+                {
+                    case SDL_WINDOWEVENT_FOCUS_GAINED:
+                        window->has_focus = true;
+                        break;
+                    case SDL_WINDOWEVENT_FOCUS_LOST:
+                        window->has_focus = false;
+                        break;
+                    case SDL_WINDOWEVENT_HIDDEN:
+                    case SDL_WINDOWEVENT_MINIMIZED:
+                        window->is_minimised = true;
+                        break;
+                    case SDL_WINDOWEVENT_MAXIMIZED:
+                    case SDL_WINDOWEVENT_RESTORED:
+                    case SDL_WINDOWEVENT_SHOWN:
+                        window->is_minimised       = false;
+                        window->is_redraw_required = true;
+                        break;
+                    case SDL_WINDOWEVENT_EXPOSED:
+                        // The window contents may have been damaged.
+                        window->is_redraw_required = true;
+                        break;
+                    case SDL_WINDOWEVENT_SIZE_CHANGED:
+                    {
+                        /* The previous logical size still fits into the
+                         * new window; the logical size is then widened on
+                         * the other axis so that the zoom level holds for
+                         * both of them. The render targets follow on the
+                         * next frame.
+                         */
+                        double zoom_level_x;
+                        double zoom_level_y;
+
+                        window->width              = core->event.handle.window.data1;
+                        window->height             = core->event.handle.window.data2;
+                        zoom_level_x               = (double)window->width  / (double)window->logical_width;
+                        zoom_level_y               = (double)window->height / (double)window->logical_height;
+                        window->is_redraw_required = true;
+
+                        esz_set_zoom_level(SDL_min(zoom_level_x, zoom_level_y), window);
+                    }
+                    break;
+                }
+                break;
         }
     }
 
@@ -174,15 +378,28 @@ void poll_events(esz_window_t* window, esz_core_t* core)
             core->camera.pos_x += 0.3f * time_factor;
         }
 
-        set_camera_boundaries_to_map_size(window, core);
+        set_camera_boundaries_to_map_size(core);
+    }
+}
+
+void set_actor_render_layers_dirty(esz_entity_t* entity, esz_core_t* core)
+{
+    for (int32_t index = 0; index < core->map->draw_layer_count; index += 1)
+    {
+        esz_draw_layer_t* draw_layer = &core->map->draw_layer[index];
+
+        if (is_actor_in_draw_layer(entity, draw_layer))
+        {
+            set_render_layer_dirty(draw_layer->render_layer, core);
+        }
     }
 }
 
-void set_camera_boundaries_to_map_size(esz_window_t* window, esz_core_t* core)
+void set_camera_boundaries_to_map_size(esz_core_t* core)
 {
     core->camera.is_at_horizontal_boundary = false;
-    core->camera.max_pos_x                 = (int32_t)core->map->width  - window->logical_width;
-    core->camera.max_pos_y                 = (int32_t)core->map->height - window->logical_height;
+    core->camera.max_pos_x                 = (int32_t)core->map->width  - core->camera.logical_width;
+    core->camera.max_pos_y                 = (int32_t)core->map->height - core->camera.logical_height;
 
     if (0 >= core->camera.pos_x)
     {
@@ -207,6 +424,148 @@ void set_camera_boundaries_to_map_size(esz_window_t* window, esz_core_t* core)
     }
 }
 
+void set_render_layer_dirty(esz_render_layer render_layer, esz_core_t* core)
+{
+    // Handed to the renderer along with the next scene snapshot.
+    if (core->is_map_loaded && ESZ_RENDER_LAYER_MAX != render_layer)
+    {
+        SET_STATE(core->map->pending_render_layer_dirty, (uint32_t)render_layer);
+    }
+}
+
+void set_tile_properties(int32_t gid, int32_t tile_index, esz_core_t* core)
+{
+    esz_tiled_tileset_t* tileset = get_head_tileset(core->map->handle);
+    esz_tiled_tile_t*    tile    = tileset->tiles;
+
+    if (tile_has_properties(gid, &tile, core->map->handle))
+    {
+        int32_t prop_cnt = get_tile_property_count(tile);
+
+        if (get_boolean_property(H_climbable, tile->properties, prop_cnt, core))
+        {
+            SET_STATE(core->map->tile_properties[tile_index], TILE_CLIMBABLE);
+        }
+
+        if (get_boolean_property(H_solid_above, tile->properties, prop_cnt, core))
+        {
+            SET_STATE(core->map->tile_properties[tile_index], TILE_SOLID_ABOVE);
+        }
+
+        if (get_boolean_property(H_solid_below, tile->properties, prop_cnt, core))
+        {
+            SET_STATE(core->map->tile_properties[tile_index], TILE_SOLID_BELOW);
+        }
+
+        if (get_boolean_property(H_solid_left, tile->properties, prop_cnt, core))
+        {
+            SET_STATE(core->map->tile_properties[tile_index], TILE_SOLID_LEFT);
+        }
+
+        if (get_boolean_property(H_solid_right, tile->properties, prop_cnt, core))
+        {
+            SET_STATE(core->map->tile_properties[tile_index], TILE_SOLID_RIGHT);
+        }
+    }
+}
+
+void update_actor_draw_layers(esz_core_t* core)
+{
+    int32_t entity_offset = 0;
+
+    for (int32_t index = 0; index < core->map->draw_layer_count; index += 1)
+    {
+        esz_draw_layer_t* draw_layer = &core->map->draw_layer[index];
+
+        if (ESZ_DRAW_ACTORS != draw_layer->type)
+        {
+            continue;
+        }
+
+        draw_layer->entity_count  = 0;
+        draw_layer->entity_offset = entity_offset;
+
+        for (int32_t entity_index = 0; entity_index < core->map->entity_count; entity_index += 1)
+        {
+            if (is_actor_in_draw_layer(&core->map->entity[entity_index], draw_layer))
+            {
+                core->map->draw_entity[entity_offset + draw_layer->entity_count]  = entity_index;
+                draw_layer->entity_count                                         += 1;
+            }
+        }
+
+        entity_offset += draw_layer->entity_count;
+    }
+}
+
+void update_background(double delta_time, esz_window_t* window, esz_core_t* core)
+{
+    double factor;
+    double time_factor = delta_time * (double)window->refresh_rate;
+
+    if (! core->is_map_loaded)
+    {
+        return;
+    }
+
+    factor = (double)core->map->background.layer_count + 1.0;
+
+    if (is_camera_at_horizontal_boundary(core))
+    {
+        if (! core->map->background.velocity_is_constant)
+        {
+            core->map->background.velocity = 0.0;
+        }
+    }
+    else
+    {
+        if (core->map->entity)
+        {
+            if (core->map->entity[core->camera.target_actor_id].actor)
+            {
+                core->map->background.velocity = core->map->entity[core->camera.target_actor_id].actor->velocity_x;
+            }
+        }
+        else
+        {
+            core->map->background.velocity = 0.0;
+        }
+    }
+
+    if (! core->camera.is_locked)
+    {
+        core->map->background.velocity = 0.0;
+    }
+
+    for (int32_t index = 0; index < core->map->background.layer_count; index += 1)
+    {
+        esz_background_layer_t* layer = &core->map->background.layer[index];
+
+        layer->velocity  = core->map->background.velocity / factor;
+        factor          -= core->map->background.layer_shift;
+
+        /* The velocity is given in pixels per frame at the monitor's
+         * refresh rate and is scaled by the actual frame time.
+         */
+        if (0 < layer->velocity && 0 < layer->width)
+        {
+            if (ESZ_RIGHT == core->map->background.direction)
+            {
+                layer->pos_x -= layer->velocity * time_factor;
+            }
+            else
+            {
+                layer->pos_x += layer->velocity * time_factor;
+            }
+
+            // The image repeats, so the position is kept within one width.
+            layer->pos_x = fmod(layer->pos_x, (double)layer->width);
+
+            set_render_layer_dirty(ESZ_BACKGROUND, core);
+        }
+    }
+}
+
 void update_bounding_box(esz_entity_t* entity)
 {
     entity->bounding_box.top    = entity->pos_y - (double)(entity->height / 2.0);
@@ -225,7 +584,7 @@ void update_bounding_box(esz_entity_t* entity)
     }
 }
 
-void update_entities(esz_window_t* window, esz_core_t* core)
+void update_entities(double delta_time, esz_core_t* core)
 {
     esz_tiled_layer_t* layer;
     int32_t            index = 0;
@@ -253,11 +612,13 @@ void update_entities(esz_window_t* window, esz_core_t* core)
                     {
                         esz_actor_t** actor                 = &entity->actor;
                         uint32_t*     state                 = &(*actor)->state;
+                        double        previous_pos_x        = entity->pos_x;
+                        double        previous_pos_y        = entity->pos_y;
+                        int32_t       previous_frame        = (*actor)->current_frame;
                         double        acceleration_x        = (*actor)->acceleration    * core->map->meter_in_pixel;
                         double        acceleration_y        = core->map->meter_in_pixel * core->map->meter_in_pixel;
-                        double        time_since_last_frame = window->time_since_last_frame;
-                        double        distance_x            = acceleration_x * time_since_last_frame * time_since_last_frame;
-                        double        distance_y            = acceleration_y * time_since_last_frame * time_since_last_frame;
+                        double        distance_x            = acceleration_x * delta_time * delta_time;
+                        double        distance_y            = acceleration_y * delta_time * delta_time;
 
                         // Vertical movement and gravity
                         // ----------------------------------------------------
@@ -417,6 +778,35 @@ void update_entities(esz_window_t* window, esz_core_t* core)
                             // tbd.
                         }
 
+                        // Update animation frame
+                        // ----------------------------------------------------
+
+                        if (IS_STATE_SET((*actor)->state, STATE_ANIMATED) && (*actor)->animation)
+                        {
+                            int32_t current_animation = (*actor)->current_animation;
+
+                            (*actor)->time_since_last_anim_frame += delta_time;
+
+                            if ((*actor)->time_since_last_anim_frame >= 1.0 / (double)((*actor)->animation[current_animation - 1].fps))
+                            {
+                                (*actor)->time_since_last_anim_frame = 0.0;
+
+                                (*actor)->current_frame += 1;
+
+                                if ((*actor)->current_frame >= (*actor)->animation[current_animation - 1].length)
+                                {
+                                    (*actor)->current_frame = 0;
+                                }
+                            }
+                        }
+
+                        if (previous_pos_x != entity->pos_x ||
+                            previous_pos_y != entity->pos_y ||
+                            previous_frame != (*actor)->current_frame)
+                        {
+                            set_actor_render_layers_dirty(entity, core);
+                        }
+
                        break;
                     }
                 }
@@ -433,3 +823,122 @@ void update_entities(esz_window_t* window, esz_core_t* core)
         layer = layer->next;
     }
 }
+
+void update_render_scale(double frame_time, double render_time, esz_window_t* window)
+{
+    double budget = 1.0 / (double)window->refresh_rate;
+    double average_frame_time;
+    double average_render_time;
+    double render_scale = window->render_scale;
+
+    window->frame_time_sum     += frame_time;
+    window->render_time_sum    += render_time;
+    window->frame_sample_count += 1;
+
+    if (ESZ_RENDER_SCALE_SAMPLES > window->frame_sample_count)
+    {
+        return;
+    }
+
+    average_frame_time  = window->frame_time_sum  / (double)window->frame_sample_count;
+    average_render_time = window->render_time_sum / (double)window->frame_sample_count;
+
+    window->frame_time_sum     = 0.0;
+    window->render_time_sum    = 0.0;
+    window->frame_sample_count = 0;
+
+    /* Hysteresis: the scale is lowered as soon as frames are late, but
+     * only raised again while rendering takes less than half of the
+     * refresh interval.
+     */
+    if (average_frame_time > budget * 1.1)
+    {
+        render_scale = SDL_max(render_scale - ESZ_RENDER_SCALE_STEP, ESZ_RENDER_SCALE_MIN);
+    }
+    else if (average_render_time < budget * 0.5)
+    {
+        render_scale = SDL_min(render_scale + ESZ_RENDER_SCALE_STEP, 1.0);
+    }
+
+    if (render_scale != window->render_scale)
+    {
+        plog_info("Set render scale to %f.", render_scale);
+        window->render_scale = render_scale;
+    }
+}
+
+void update_tile_animations(esz_window_t* window, esz_core_t* core)
+{
+    double  frame_duration;
+    int32_t frame_steps;
+
+    if (! core->is_map_loaded || 0 >= core->map->animated_tile_fps || 0 == core->map->animated_tile_index)
+    {
+        return;
+    }
+
+    frame_duration                         = 1.0 / (double)(core->map->animated_tile_fps);
+    core->map->time_since_last_anim_frame += window->time_since_last_frame;
+
+    if (core->map->time_since_last_anim_frame < frame_duration)
+    {
+        return;
+    }
+
+    // Keep the remainder, so that the animation doesn't drift.
+    frame_steps                            = (int32_t)(core->map->time_since_last_anim_frame / frame_duration);
+    core->map->time_since_last_anim_frame -= (double)frame_steps * frame_duration;
+    core->map->animated_tile_tick         += 1;
+
+    for (int32_t index = 0; index < core->map->tile_animation_count; index += 1)
+    {
+        esz_tile_animation_t* tile_animation = &core->map->tile_animation[index];
+
+        tile_animation->current_frame = (tile_animation->current_frame + frame_steps) % tile_animation->frame_count;
+    }
+
+    // Tile animations are advanced by the renderer itself.
+    core->map->render_layer_dirty |= core->map->animated_render_layers;
+}
+
+void update_tile_properties(int32_t index_width, int32_t index_height, esz_core_t* core)
+{
+    esz_tiled_layer_t* layer      = get_head_layer(core->map->handle);
+    int32_t            tile_index = (index_height * (int32_t)core->map->handle->width) + index_width;
+
+    // The properties of all tiles stacked on this cell are combined.
+    core->map->tile_properties[tile_index] = 0;
+
+    while (layer)
+    {
+        if (is_tiled_layer_of_type(ESZ_TILE_LAYER, layer, core))
+        {
+            int32_t* layer_content = get_layer_content(layer);
+
+            set_tile_properties(remove_gid_flip_bits((int32_t)layer_content[tile_index]), tile_index, core);
+        }
+        layer = layer->next;
+    }
+}
+
+void wait_until(uint64_t target_counter)
+{
+    double   frequency = (double)SDL_GetPerformanceFrequency();
+    uint64_t counter   = SDL_GetPerformanceCounter();
+
+    /* SDL_Delay() may oversleep by a millisecond or more depending on
+     * the scheduler, so it is only used until shortly before the
+     * deadline.  The rest of the time is spent spinning.
+     */
+    while (counter < target_counter)
+    {
+        double remaining_time = (double)(target_counter - counter) / frequency;
+
+        if (remaining_time > ESZ_FRAME_SPIN_TIME)
+        {
+            SDL_Delay((uint32_t)((remaining_time - ESZ_FRAME_SPIN_TIME) * 1000.0));
+        }
+
+        counter = SDL_GetPerformanceCounter();
+    }
+}
@@ -13,15 +13,34 @@
 
 #include "esz_types.h"
 
-bool        get_boolean_property(const uint64_t name_hash, esz_tiled_property_t* properties, int32_t property_count, esz_core_t* core);
-double      get_decimal_property(const uint64_t name_hash, esz_tiled_property_t* properties, int32_t property_count, esz_core_t* core);
-int32_t     get_integer_property(const uint64_t name_hash, esz_tiled_property_t* properties, int32_t property_count, esz_core_t* core);
-const char* get_string_property(const uint64_t name_hash, esz_tiled_property_t*  properties, int32_t property_count, esz_core_t* core);
-bool        is_camera_at_horizontal_boundary(esz_core_t* core);
-void        move_camera_to_target(esz_window_t* window, esz_core_t* core);
-void        poll_events(esz_window_t* window, esz_core_t* core);
-void        set_camera_boundaries_to_map_size(esz_window_t* window, esz_core_t* core);
-void        update_bounding_box(esz_entity_t* entity);
-void        update_entities(esz_window_t* window, esz_core_t* core);
+esz_status       add_tile_to_layer_index(int32_t layer_position, int32_t index_width, int32_t index_height, esz_core_t* core);
+bool             get_boolean_property(const uint64_t name_hash, esz_tiled_property_t* properties, int32_t property_count, esz_core_t* core);
+double           get_decimal_property(const uint64_t name_hash, esz_tiled_property_t* properties, int32_t property_count, esz_core_t* core);
+int32_t          get_integer_property(const uint64_t name_hash, esz_tiled_property_t* properties, int32_t property_count, esz_core_t* core);
+esz_map_chunk_t* get_map_chunk(int32_t pos_x, int32_t pos_y, esz_core_t* core);
+int32_t          get_mip_level(esz_window_t* window);
+int32_t          get_render_target_bucket(int32_t size);
+void             get_render_target_size(int32_t* width, int32_t* height, esz_window_t* window);
+const char*      get_string_property(const uint64_t name_hash, esz_tiled_property_t*  properties, int32_t property_count, esz_core_t* core);
+int32_t          get_tile_chunk_index(int32_t index_width, int32_t index_height, esz_core_t* core);
+esz_tile_opacity get_tile_opacity(int32_t gid, esz_core_t* core);
+bool             is_actor_in_draw_layer(esz_entity_t* entity, esz_draw_layer_t* draw_layer);
+bool             is_actor_layer_state(esz_state state);
+bool             is_camera_at_horizontal_boundary(esz_core_t* core);
+bool             is_tile_layer_animated(int32_t layer_index, esz_core_t* core);
+void             move_camera_to_target(esz_core_t* core);
+void             poll_events(esz_window_t* window, esz_core_t* core);
+void             set_actor_render_layers_dirty(esz_entity_t* entity, esz_core_t* core);
+void             set_camera_boundaries_to_map_size(esz_core_t* core);
+void             set_render_layer_dirty(esz_render_layer render_layer, esz_core_t* core);
+void             set_tile_properties(int32_t gid, int32_t tile_index, esz_core_t* core);
+void             update_actor_draw_layers(esz_core_t* core);
+void             update_background(double delta_time, esz_window_t* window, esz_core_t* core);
+void             update_bounding_box(esz_entity_t* entity);
+void             update_entities(double delta_time, esz_core_t* core);
+void             update_render_scale(double frame_time, double render_time, esz_window_t* window);
+void             update_tile_animations(esz_window_t* window, esz_core_t* core);
+void             update_tile_properties(int32_t index_width, int32_t index_height, esz_core_t* core);
+void             wait_until(uint64_t target_counter);
 
 #endif // ESZ_UTILS_H